@@ -254,10 +254,12 @@ copy lib\fnmatch.in.h %OUTDIR%\lib\fnmatch.h
 
 if exist %OUTDIR%\link.sc del %OUTDIR%\link.sc
 
+call :Compile src/applog
 call :Compile src/ar
 call :Compile src/arscan
 call :Compile src/commands
 call :Compile src/default
+call :Compile src/deplog
 call :Compile src/dir
 call :Compile src/expand
 call :Compile src/file
@@ -277,7 +279,10 @@ call :Compile src/read
 call :Compile src/remake
 call :Compile src/remote-stub
 call :Compile src/rule
+call :Compile src/sha1
+call :Compile src/shcache
 call :Compile src/shuffle
+call :Compile src/statcache
 call :Compile src/signame
 call :Compile src/strcache
 call :Compile src/variable
@@ -0,0 +1,270 @@
+/* Files of length-prefixed records for GNU Make.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#include "applog.h"
+
+#include "variable.h"
+#include "hash.h"
+
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
+
+/* The dependency log, the shell cache and the stat cache are all kept in
+   files of the same shape: some text identifying the kind of file, possibly
+   a fixed-size header, then any number of records.  Each record is a 4-byte
+   little-endian length followed by that many bytes, whose meaning is up to
+   the user of the file.
+
+   The dependency log and the shell cache are appended to as make runs, and
+   the last record for a given key wins; they are rewritten from scratch now
+   and again to drop the records which have been superseded.  The stat cache
+   is always rewritten in place.
+
+   If make is killed while appending a record, the file is left with part of
+   a record at the end.  Anything appended after it would be read as part of
+   the broken record, so before a file is appended to any such remains are
+   cut off.  */
+
+/* Return the value of the variable NAME, stripped, or NULL if it's empty or
+   not set.  The caller must free the result.  */
+
+char *
+applog_variable (const char *name, size_t length)
+{
+  char *result = NULL;
+
+  if (lookup_variable (name, length) != NULL)
+    {
+      const char *beg;
+      const char *end;
+      char *value = allocated_expand_variable (name, length);
+
+      beg = value;
+      end = beg + strlen (beg) - 1;
+      strip_whitespace (&beg, &end);
+      if (beg <= end && *beg != '\0')
+        result = xstrndup (beg, end - beg + 1);
+      free (value);
+    }
+
+  return result;
+}
+
+unsigned long
+applog_get_length (const char *p)
+{
+  const unsigned char *u = (const unsigned char *) p;
+  return ((unsigned long) u[0] | ((unsigned long) u[1] << 8)
+          | ((unsigned long) u[2] << 16) | ((unsigned long) u[3] << 24));
+}
+
+void
+applog_put_length (char *p, unsigned long len)
+{
+  p[0] = (char) (len & 0xff);
+  p[1] = (char) ((len >> 8) & 0xff);
+  p[2] = (char) ((len >> 16) & 0xff);
+  p[3] = (char) ((len >> 24) & 0xff);
+}
+
+/* Wait for a lock on the whole of the file open on FD, which is only shared
+   if EXCLUSIVE is zero.  The lock is released when the file is closed.  */
+
+void
+applog_lock (int fd, int exclusive)
+{
+#ifdef F_SETLKW
+  struct flock fl;
+  int e;
+
+  fl.l_type = exclusive ? F_WRLCK : F_RDLCK;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 0;
+  EINTRLOOP (e, fcntl (fd, F_SETLKW, &fl));
+#else
+  (void) fd;
+  (void) exclusive;
+#endif
+}
+
+/* Read the file LOG->name into LOG->buf, and pass each record in it to
+   RECORD along with ARG.  Reading stops at the first record that is cut
+   short or that RECORD rejects.  If LOG->cut is set, that record and
+   anything after it are removed from the file.
+
+   Return 1 if the file was read, 0 if it doesn't exist, or -1 if it exists
+   but must not be appended to.  The records read are kept in LOG->buf even
+   if -1 is returned; it is NULL if there are none.  */
+
+int
+applog_read (struct applog *log, applog_record_fn record, void *arg)
+{
+  size_t magiclen = strlen (log->magic);
+  int writable = log->cut;
+  int r = 1;
+  struct stat st;
+  const char *p;
+  const char *end;
+  FILE *fp = NULL;
+
+  log->buf = NULL;
+  log->len = 0;
+  log->nrecords = 0;
+
+  if (writable)
+    {
+      ENULLLOOP (fp, fopen (log->name, "r+b"));
+      if (fp == NULL && errno != ENOENT)
+        writable = 0;
+    }
+  if (!writable)
+    ENULLLOOP (fp, fopen (log->name, "rb"));
+  if (fp == NULL)
+    {
+      if (errno == ENOENT)
+        return 0;
+      perror_with_name ("fopen: ", log->name);
+      return -1;
+    }
+
+  /* Don't cut off a record which another make is still writing.  */
+  applog_lock (fileno (fp), writable);
+  if (fstat (fileno (fp), &st) != 0 || !S_ISREG (st.st_mode)
+      || (uintmax_t) st.st_size >= SIZE_MAX)
+    {
+      fclose (fp);
+      return -1;
+    }
+
+  log->buf = xmalloc ((size_t) st.st_size + 1);
+  log->len = fread (log->buf, 1, (size_t) st.st_size, fp);
+
+  if (log->len < magiclen + log->hdrlen
+      || memcmp (log->buf, log->magic, magiclen) != 0)
+    {
+      OS (error, NILF, log->badfmt, log->name);
+      fclose (fp);
+      free (log->buf);
+      log->buf = NULL;
+      return -1;
+    }
+
+  p = log->buf + magiclen + log->hdrlen;
+  end = log->buf + log->len;
+  while (end - p >= 4)
+    {
+      unsigned long rlen = applog_get_length (p);
+
+      if (rlen > (unsigned long) (end - p - 4)
+          || !(*record) (p + 4, rlen, arg))
+        break;
+
+      ++log->nrecords;
+      p += 4 + rlen;
+    }
+
+  if (p != end && log->cut)
+    {
+      int e = -1;
+
+      if (writable)
+        EINTRLOOP (e, ftruncate (fileno (fp), p - log->buf));
+      if (e != 0)
+        {
+          if (writable)
+            perror_with_name ("ftruncate: ", log->name);
+          r = -1;
+        }
+    }
+
+  fclose (fp);
+
+  return r;
+}
+
+/* Append the record for ITEM, written by WRITER, to the log NAME, which is
+   created starting with MAGIC if it doesn't exist.  Return 0 on failure.  */
+
+int
+applog_append (const char *name, const char *magic,
+               applog_write_fn writer, const void *item)
+{
+  FILE *fp;
+  int ok;
+
+  ENULLLOOP (fp, fopen (name, "ab"));
+  ok = fp != NULL;
+  if (ok)
+    {
+      /* Other makes could be appending to the same log.  */
+      applog_lock (fileno (fp), 1);
+      fseek (fp, 0, SEEK_END);
+      if (ftell (fp) == 0)
+        ok = fwrite (magic, 1, strlen (magic), fp) == strlen (magic);
+      if (ok)
+        ok = (*writer) (fp, item);
+      if (fclose (fp) != 0)
+        ok = 0;
+    }
+  if (!ok)
+    perror_with_name ("", name);
+
+  return ok;
+}
+
+/* Replace the log NAME with one holding the records written by WRITER for
+   the items in TABLE.  */
+
+void
+applog_rewrite (const char *name, const char *magic,
+                applog_write_fn writer, struct hash_table *table)
+{
+  char *tmp = xstrdup (concat (2, name, ".tmp"));
+  void **items;
+  void **ip;
+  FILE *fp;
+  int ok;
+
+  ENULLLOOP (fp, fopen (tmp, "wb"));
+  if (fp == NULL)
+    {
+      perror_with_name ("fopen: ", tmp);
+      free (tmp);
+      return;
+    }
+
+  ok = fwrite (magic, 1, strlen (magic), fp) == strlen (magic);
+
+  items = hash_dump (table, NULL, NULL);
+  for (ip = items; ok && *ip != NULL; ++ip)
+    ok = (*writer) (fp, *ip);
+  free (items);
+
+  if (fclose (fp) != 0)
+    ok = 0;
+
+  if (!ok || rename (tmp, name) != 0)
+    {
+      perror_with_name ("", tmp);
+      unlink (tmp);
+    }
+
+  free (tmp);
+}
@@ -0,0 +1,50 @@
+/* Declarations for files of length-prefixed records.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+struct hash_table;
+
+/* A log file being read: see applog.c.  */
+struct applog
+  {
+    const char *name;           /* The name of the file.  */
+    const char *magic;          /* The text the file must start with.  */
+    size_t hdrlen;              /* The number of bytes after MAGIC before the
+                                   first record.  */
+    const char *badfmt;         /* Message if the file doesn't start with
+                                   MAGIC, with %s for its name.  */
+    int cut;                    /* Nonzero if damaged records at the end
+                                   should be cut off.  */
+    char *buf;                  /* The contents of the file.  */
+    size_t len;                 /* The number of bytes in BUF.  */
+    unsigned long nrecords;     /* The number of records accepted.  */
+  };
+
+/* Check a record of LEN bytes at REC: return 0 to stop reading.  */
+typedef int (*applog_record_fn) (const char *rec, unsigned long len,
+                                 void *arg);
+
+/* Write the record for ITEM, including its length, to FP.  */
+typedef int (*applog_write_fn) (FILE *fp, const void *item);
+
+char *applog_variable (const char *name, size_t length);
+unsigned long applog_get_length (const char *p);
+void applog_put_length (char *p, unsigned long len);
+void applog_lock (int fd, int exclusive);
+int applog_read (struct applog *log, applog_record_fn record, void *arg);
+int applog_append (const char *name, const char *magic,
+                   applog_write_fn writer, const void *item);
+void applog_rewrite (const char *name, const char *magic,
+                     applog_write_fn writer, struct hash_table *table);
@@ -35,6 +35,7 @@ struct nameseq
 #define RM_INCLUDED             (1 << 1) /* Search makefile search path.  */
 #define RM_DONTCARE             (1 << 2) /* No error if it doesn't exist.  */
 #define RM_NO_TILDE             (1 << 3) /* Don't expand ~ in file name.  */
+#define RM_DEPFILE              (1 << 4) /* Try the dependency file loader.  */
 
 /* Structure representing one dependency of a file.
    Each struct file's 'deps' points to a chain of these, through 'next'.
@@ -103,7 +104,7 @@ struct nameseq *ar_glob (const char *arname, const char *member_pattern, size_t
 
 #define dep_name(d)       ((d)->name ? (d)->name : (d)->file->name)
 
-#define alloc_seq_elt(_t) xcalloc (sizeof (_t))
+#define alloc_seq_elt(_t) alloc_record (sizeof (_t))
 void free_ns_chain (struct nameseq *n);
 
 #if defined(MAKE_MAINTAINER_MODE) && defined(__GNUC__) && !defined(__STRICT_ANSI__)
@@ -113,7 +114,7 @@ SI struct nameseq *alloc_ns (void)    { return alloc_seq_elt (struct nameseq); }
 SI struct dep *alloc_dep (void)       { return alloc_seq_elt (struct dep); }
 SI struct goaldep *alloc_goaldep (void) { return alloc_seq_elt (struct goaldep); }
 
-SI void free_ns (struct nameseq *n)      { free (n); }
+SI void free_ns (struct nameseq *n)      { free_record (n); }
 SI void free_dep (struct dep *d)         { free_ns ((struct nameseq *)d); }
 SI void free_goaldep (struct goaldep *g) { free_dep ((struct dep *)g); }
 SI void free_dep_chain (struct dep *d)   { free_ns_chain((struct nameseq *)d); }
@@ -123,7 +124,7 @@ SI void free_goal_chain (struct goaldep *g) { free_dep_chain((struct dep *)g); }
 # define alloc_dep()         alloc_seq_elt (struct dep)
 # define alloc_goaldep()     alloc_seq_elt (struct goaldep)
 
-# define free_ns(_n)         free (_n)
+# define free_ns(_n)         free_record (_n)
 # define free_dep(_d)        free_ns (_d)
 # define free_goaldep(_g)    free_dep (_g)
 
@@ -133,7 +134,9 @@ SI void free_goal_chain (struct goaldep *g) { free_dep_chain((struct dep *)g); }
 
 struct dep *copy_dep (const struct dep *d);
 struct dep *copy_dep_chain (const struct dep *d);
+void compact_dep_chains (struct dep **chains[], unsigned int n);
 
 struct goaldep *read_all_makefiles (const char **makefiles);
 void eval_buffer (char *buffer, const floc *floc);
 enum update_status update_goal_chain (struct goaldep *goals);
+void prefetch_mtimes (struct goaldep *goals);
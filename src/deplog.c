@@ -0,0 +1,439 @@
+/* Dependency log support for GNU Make.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#include "deplog.h"
+
+#include "applog.h"
+#include "filedef.h"
+#include "dep.h"
+#include "variable.h"
+#include "debug.h"
+#include "hash.h"
+
+/* The dependency log holds the prerequisites reported by the compiler for
+   each target which sets .DEPFILE, so that they can be added to the
+   database on the next run without reading any dependency files.
+
+   The log starts with DEPLOG_MAGIC, followed by any number of records, in
+   the form described in applog.c.  Each record holds the target name then
+   each prerequisite name, each terminated by a NUL.  New
+   records are appended as targets are rebuilt and the last record for a
+   target wins.  A truncated record at the end of the log, which might be
+   left if make is killed while writing it, is cut off when the log is
+   read.  */
+
+#define DEPLOG_DEFAULT  ".make.deps"
+#define DEPLOG_MAGIC    "GNU make dependency log 1\n"
+
+/* Rewrite the log when it has at least this many records and more than
+   half of them have been superseded by later ones.  */
+#define DEPLOG_COMPACT_MIN 1000
+
+struct deplog_entry
+  {
+    const char *target;         /* The target name, in the strcache.  */
+    const char *prereqs;        /* NUL-terminated prerequisite names.  */
+    size_t len;                 /* Total length of PREREQS.  */
+  };
+
+/* Set if the log exists but can't be used: we won't append to it.  */
+static int deplog_unusable = 0;
+
+static unsigned long
+deplog_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((struct deplog_entry const *) key)->target);
+}
+
+static unsigned long
+deplog_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((struct deplog_entry const *) key)->target);
+}
+
+static int
+deplog_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((struct deplog_entry const *) x)->target,
+                         ((struct deplog_entry const *) y)->target);
+}
+
+/* A set of addresses, used to avoid adding duplicate prerequisites.  */
+
+static unsigned long
+seen_hash_1 (const void *key)
+{
+  return_ADDRESS_HASH_1 (key);
+}
+
+static unsigned long
+seen_hash_2 (const void *key)
+{
+  return_ADDRESS_HASH_2 (key);
+}
+
+static int
+seen_hash_cmp (const void *x, const void *y)
+{
+  return x != y;
+}
+
+/* Return the name of the dependency log.  */
+
+static const char *
+deplog_name (void)
+{
+  static char *name = NULL;
+
+  if (name == NULL)
+    {
+      name = applog_variable (STRING_SIZE_TUPLE (".DEPLOG"));
+      if (name == NULL)
+        name = xstrdup (DEPLOG_DEFAULT);
+    }
+
+  return name;
+}
+
+/* Write a record for the deplog_entry ITEM to FP.  Return 0 on failure.  */
+
+static int
+write_record (FILE *fp, const void *item)
+{
+  const struct deplog_entry *entry = item;
+  size_t tlen = strlen (entry->target) + 1;
+  char hdr[4];
+
+  applog_put_length (hdr, tlen + entry->len);
+  return (fwrite (hdr, 1, sizeof (hdr), fp) == sizeof (hdr)
+          && fwrite (entry->target, 1, tlen, fp) == tlen
+          && fwrite (entry->prereqs, 1, entry->len, fp) == entry->len);
+}
+
+/* Add the record of LEN bytes at REC to the hash table ARG.  */
+
+static int
+read_record (const char *rec, unsigned long len, void *arg)
+{
+  struct deplog_entry *entry;
+  size_t tlen;
+
+  if (len == 0 || rec[len - 1] != '\0')
+    return 0;
+
+  tlen = strlen (rec) + 1;
+  entry = xmalloc (sizeof (struct deplog_entry));
+  entry->target = strcache_add (rec);
+  entry->prereqs = rec + tlen;
+  entry->len = len - tlen;
+
+  free (hash_insert (arg, entry));
+  return 1;
+}
+
+/* Add the prerequisites in ENTRY to its target, if the target is known.  */
+
+static void
+apply_entry (const void *item, void *arg)
+{
+  const struct deplog_entry *entry = item;
+  struct hash_table *seen = arg;
+  struct file *f = lookup_file (entry->target);
+  struct dep **dp;
+  const char *p;
+  const char *end;
+
+  /* If the makefiles no longer mention this target, forget about it.  */
+  if (f == NULL || f->double_colon)
+    return;
+
+  hash_delete_items (seen);
+  hash_insert (seen, f);
+  for (dp = &f->deps; *dp != NULL; dp = &(*dp)->next)
+    if ((*dp)->file)
+      hash_insert (seen, (*dp)->file);
+
+  end = entry->prereqs + entry->len;
+  for (p = entry->prereqs; p < end; p += strlen (p) + 1)
+    {
+      struct file *pf = lookup_file (p);
+      void **slot;
+
+      if (pf == NULL)
+        pf = enter_file (strcache_add (p));
+
+      slot = hash_find_slot (seen, pf);
+      if (!HASH_VACANT (*slot))
+        continue;
+      hash_insert_at (seen, pf, slot);
+
+      *dp = alloc_dep ();
+      (*dp)->file = pf;
+      dp = &(*dp)->next;
+
+      /* As with GCC's -MP option, a prerequisite that is later removed
+         shouldn't cause an error: treat it as a target with no recipe.  */
+      pf->is_target = 1;
+    }
+}
+
+/* Read the dependency log, if there is one, and add the prerequisites it
+   records to each target that is in the database.  This must be called
+   after all the makefiles have been read, and before snap_deps().  */
+
+void
+deplog_load (void)
+{
+  struct applog log;
+  struct hash_table table;
+  struct hash_table seen;
+  int r;
+
+  log.name = deplog_name ();
+  log.magic = DEPLOG_MAGIC;
+  log.hdrlen = 0;
+  log.badfmt = _("%s: unrecognized dependency log format; ignoring");
+  log.cut = 1;
+
+  hash_init (&table, 1024, deplog_hash_1, deplog_hash_2, deplog_hash_cmp);
+
+  r = applog_read (&log, read_record, &table);
+  if (r < 0)
+    deplog_unusable = 1;
+  if (log.buf == NULL)
+    {
+      hash_free (&table, 1);
+      return;
+    }
+
+  DB (DB_VERBOSE, (_("Reading dependency log '%s'...\n"), log.name));
+
+  hash_init (&seen, 256, seen_hash_1, seen_hash_2, seen_hash_cmp);
+  hash_map_arg (&table, apply_entry, &seen);
+  hash_free (&seen, 0);
+
+  if (r > 0 && log.nrecords >= DEPLOG_COMPACT_MIN
+      && log.nrecords > 2 * table.ht_fill)
+    {
+      DB (DB_VERBOSE, (_("Compacting dependency log '%s'\n"), log.name));
+      applog_rewrite (log.name, DEPLOG_MAGIC, write_record, &table);
+    }
+
+  hash_free (&table, 1);
+  free (log.buf);
+}
+
+/* Append the word in BUF of length LEN to the prerequisites in RECORD,
+   unless it was seen before.  */
+
+static void
+add_prereq (struct hash_table *seen, char **record, size_t *rlen,
+            size_t *rsize, const char *buf, size_t len)
+{
+  const char *name = strcache_add_len (buf, len);
+  void **slot = hash_find_slot (seen, name);
+
+  if (!HASH_VACANT (*slot))
+    return;
+  hash_insert_at (seen, name, slot);
+
+  if (*rlen + len + 1 > *rsize)
+    {
+      *rsize = (*rlen + len + 1) * 2;
+      *record = xrealloc (*record, *rsize);
+    }
+  memcpy (*record + *rlen, name, len + 1);
+  *rlen += len + 1;
+}
+
+/* Parse the dependency file contents in BUF, which is NUL-terminated, and
+   return the prerequisites of all of its rules in the format used by log
+   records.  Store the length of the result in *LENP.  TARGET is omitted.  */
+
+static char *
+parse_depfile (const char *buf, const char *target, size_t *lenp)
+{
+  struct hash_table seen;
+  size_t rsize = 256;
+  size_t rlen = 0;
+  char *record = xmalloc (rsize);
+  size_t wsize = 256;
+  size_t wlen = 0;
+  char *word = xmalloc (wsize);
+  int in_prereqs = 0;
+  const char *p = buf;
+
+  hash_init (&seen, 256, seen_hash_1, seen_hash_2, seen_hash_cmp);
+  hash_insert (&seen, strcache_add (target));
+
+  while (1)
+    {
+      char c = *p;
+      int eow = 0;
+
+      if (c == '\\' && p[1] == '\n')
+        {
+          /* A continuation line: treat it as whitespace.  */
+          p += 2;
+          eow = 1;
+        }
+      else if (c == '\\' && p[1] == '\r' && p[2] == '\n')
+        {
+          p += 3;
+          eow = 1;
+        }
+      else if (c == '\0' || c == '\n' || c == '#')
+        {
+          /* End of the rule.  Discard any comment.  */
+          if (c == '#')
+            while (p[1] != '\0' && p[1] != '\n')
+              ++p;
+          eow = 1;
+        }
+      else if (ISSPACE (c))
+        eow = 1;
+      else if (c == ':' && !in_prereqs
+#ifdef HAVE_DOS_PATHS
+               && !(wlen == 1 && (p[1] == '/' || p[1] == '\\'))
+#endif
+               )
+        {
+          /* The end of the targets.  */
+          wlen = 0;
+          in_prereqs = 1;
+          ++p;
+          continue;
+        }
+
+      if (eow)
+        {
+          if (wlen > 0 && in_prereqs)
+            add_prereq (&seen, &record, &rlen, &rsize, word, wlen);
+          wlen = 0;
+
+          if (c == '\0')
+            break;
+          if (c == '\n' || c == '#')
+            in_prereqs = 0;
+          if (c != '\\')
+            ++p;
+          continue;
+        }
+
+      /* Add a character to the current word, removing escapes.  */
+      if ((c == '\\' && (p[1] == ' ' || p[1] == '\t' || p[1] == '#'
+                         || p[1] == ':'))
+          || (c == '$' && p[1] == '$'))
+        c = *(++p);
+
+      if (wlen + 1 >= wsize)
+        {
+          wsize *= 2;
+          word = xrealloc (word, wsize);
+        }
+      word[wlen++] = c;
+      ++p;
+    }
+
+  hash_free (&seen, 0);
+  free (word);
+  *lenp = rlen;
+  return record;
+}
+
+/* FILE has been successfully remade.  If it has a .DEPFILE, read the
+   prerequisites from that file, add them to the dependency log, then
+   delete the dependency file.  */
+
+void
+deplog_record (struct file *file)
+{
+  struct deplog_entry entry;
+  char *value;
+  const char *beg;
+  const char *end;
+  char *depfile;
+  char *buf;
+  char *record;
+  size_t len;
+  struct stat st;
+  FILE *fp;
+  int ok;
+
+  if (lookup_variable_for_file (STRING_SIZE_TUPLE (".DEPFILE"), file) == NULL)
+    return;
+
+  value = allocated_expand_variable_for_file (STRING_SIZE_TUPLE (".DEPFILE"),
+                                              file);
+  beg = value;
+  end = beg + strlen (beg) - 1;
+  strip_whitespace (&beg, &end);
+  if (beg > end || *beg == '\0')
+    {
+      free (value);
+      return;
+    }
+  depfile = xstrndup (beg, end - beg + 1);
+  free (value);
+
+  /* If the recipe didn't write a dependency file, keep any old record.  */
+  ENULLLOOP (fp, fopen (depfile, "rb"));
+  if (fp == NULL)
+    {
+      if (errno != ENOENT)
+        perror_with_name ("fopen: ", depfile);
+      free (depfile);
+      return;
+    }
+
+  if (fstat (fileno (fp), &st) != 0 || (uintmax_t) st.st_size >= SIZE_MAX)
+    {
+      perror_with_name ("fstat: ", depfile);
+      fclose (fp);
+      free (depfile);
+      return;
+    }
+
+  len = (size_t) st.st_size;
+  buf = xmalloc (len + 1);
+  len = fread (buf, 1, len, fp);
+  buf[len] = '\0';
+  fclose (fp);
+
+  record = parse_depfile (buf, file->name, &len);
+  free (buf);
+
+  DB (DB_VERBOSE, (_("Recording prerequisites of '%s' from '%s'\n"),
+                   file->name, depfile));
+
+  entry.target = file->name;
+  entry.prereqs = record;
+  entry.len = len;
+
+  ok = !deplog_unusable && applog_append (deplog_name (), DEPLOG_MAGIC,
+                                          write_record, &entry);
+  if (!ok)
+    deplog_unusable = 1;
+
+  /* Now that the prerequisites are in the log we don't need the file.  */
+  if (ok && unlink (depfile) != 0 && errno != ENOENT)
+    perror_with_name ("unlink: ", depfile);
+
+  free (record);
+  free (depfile);
+}
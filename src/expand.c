@@ -136,6 +136,537 @@ swap_variable_buffer (char *buf, size_t len)
 }
 
 
+/* Compiled values of recursive variables.
+
+   Each time a recursive variable is expanded its value must be scanned for
+   variable references and function calls.  Most variables are expanded many
+   times but rarely change, so the second time a variable is expanded its
+   value is parsed into a list of items, which that and later expansions
+   interpret directly.  The compiled form is forgotten whenever the value
+   changes.  Anything unusual, such as a computed variable name or an
+   unterminated reference, is left as a string for expand_string_buf.  */
+
+enum item_type
+  {
+    i_text,             /* Literal text.  */
+    i_variable,         /* A variable reference: $(NAME) or $N.  */
+    i_subst,            /* A substitution reference: $(NAME:PAT=REPL).  */
+    i_function,         /* A call to a builtin function.  */
+    i_string            /* Anything else: expanded by expand_string_buf.  */
+  };
+
+struct item
+  {
+    enum item_type type;
+    const char *src;            /* Start of this item in the value.  */
+    const char *text;           /* Text, variable name, or arguments.  */
+    size_t length;              /* Length of TEXT.  */
+
+    /* For i_function.  Each argument is compiled if the function expands
+       its arguments; if not ARGOFFS holds the offset of each one in TEXT.  */
+    const struct function_table_entry *func;
+    unsigned int nargs;
+    struct expansion **args;
+    size_t *argoffs;
+
+    /* For i_subst, as needed by patsubst_expand_pat().  */
+    char *subst;
+    const char *pattern, *replace, *ppercent, *rpercent;
+  };
+
+struct expansion
+  {
+    char *text;                 /* Our copy of the value.  */
+    struct item *items;         /* The parsed value.  */
+    unsigned int count;         /* Number of ITEMS.  */
+    unsigned int size;          /* Number of ITEMS allocated.  */
+    unsigned int refs;          /* The variable, and expansions in progress.  */
+    unsigned long funcnum;      /* function_changenum when compiled.  */
+  };
+
+static struct expansion *compile_expansion (const char *string, size_t length);
+
+/* Set up the percent pointers for a substitution reference.  *PATTERNP and
+   *REPLACEP must each be preceded by a spare byte containing '%', to use in
+   case there isn't one in the pattern.  */
+
+static void
+prepare_subst (char **patternp, char **replacep,
+               char **ppercentp, char **rpercentp)
+{
+  /* Look for %.  Set the percent pointers properly
+     based on whether we find one or not.  */
+  *ppercentp = find_percent (*patternp);
+  if (*ppercentp)
+    {
+      ++*ppercentp;
+      *rpercentp = find_percent (*replacep);
+      if (*rpercentp)
+        ++*rpercentp;
+    }
+  else
+    {
+      *ppercentp = *patternp;
+      *rpercentp = *replacep;
+      --*patternp;
+      --*replacep;
+    }
+}
+
+/* Expand the substitution reference $(NAME:PATTERN=REPLACE), where NAME is
+   LENGTH chars long, into the buffer at O.  The pattern arguments are as
+   set up by prepare_subst.  Returns the new end of the buffer.  */
+
+static char *
+subst_reference_output (char *o, const char *name, size_t length,
+                        const char *pattern, const char *replace,
+                        const char *ppercent, const char *rpercent)
+{
+  struct variable *v = lookup_variable (name, length);
+
+  if (v == 0)
+    warn_undefined (name, length);
+
+  /* If the variable is not empty, perform the substitution.  */
+  if (v != 0 && *v->value != '\0')
+    {
+      /* Remember this since expansion could change it.  */
+      unsigned int recursive = v->recursive;
+      char *value = recursive ? recursively_expand (v) : v->value;
+
+      o = patsubst_expand_pat (o, value, pattern, replace,
+                               ppercent, rpercent);
+
+      if (recursive)
+        free (value);
+    }
+
+  return o;
+}
+
+static struct item *
+add_item (struct expansion *exp, enum item_type type, const char *src,
+          const char *text, size_t length)
+{
+  struct item *it;
+
+  if (exp->count == exp->size)
+    {
+      exp->size = exp->size ? exp->size * 2 : 4;
+      exp->items = xrealloc (exp->items, exp->size * sizeof (struct item));
+    }
+
+  it = &exp->items[exp->count++];
+  memset (it, '\0', sizeof (struct item));
+  it->type = type;
+  it->src = src;
+  it->text = text;
+  it->length = length;
+
+  return it;
+}
+
+/* Compile the arguments of a call to the function in IT, which are in TEXT
+   up to END.  NARGS is an estimate of their number which is never low.
+   The arguments are split just as handle_function would split them.  */
+
+static void
+compile_function_args (struct item *it, char openparen, const char *end,
+                       unsigned int nargs)
+{
+  const char *p;
+  unsigned int n;
+
+  if (function_expands_args (it->func))
+    it->args = xmalloc (nargs * sizeof (struct expansion *));
+  else
+    it->argoffs = xmalloc ((nargs + 1) * sizeof (size_t));
+
+  for (p = it->text, n = 0; p <= end; ++n)
+    {
+      const char *next = function_argument_end (it->func, n + 1, openparen,
+                                                p, end);
+      if (it->args)
+        it->args[n] = compile_expansion (p, next - p);
+      else
+        it->argoffs[n] = p - it->text;
+      p = next + 1;
+    }
+
+  it->nargs = n;
+  if (it->argoffs)
+    it->argoffs[n] = end - it->text + 1;
+}
+
+/* Parse the LENGTH chars of STRING into a new compiled expansion.
+   This must agree exactly with the way expand_string_buf interprets it.  */
+
+static struct expansion *
+compile_expansion (const char *string, size_t length)
+{
+  struct expansion *exp = xcalloc (sizeof (struct expansion));
+  const char *p, *p1;
+
+  exp->text = xstrndup (string, length);
+  exp->refs = 1;
+  exp->funcnum = function_changenum;
+
+  p = exp->text;
+  while (1)
+    {
+      p1 = strchr (p, '$');
+
+      if (p1 != p && *p != '\0')
+        add_item (exp, i_text, p, p, p1 != 0 ? (size_t) (p1 - p) : strlen (p));
+
+      if (p1 == 0)
+        break;
+      p = p1 + 1;
+
+      switch (*p)
+        {
+        case '$':
+        case '\0':
+          add_item (exp, i_text, p1, p1, 1);
+          break;
+
+        case '(':
+        case '{':
+          {
+            char openparen = *p;
+            char closeparen = (openparen == '(') ? ')' : '}';
+            const struct function_table_entry *func;
+            const char *beg, *end, *colon, *subst_end;
+            unsigned int nargs;
+
+            func = find_function_call (p, &beg, &end, &nargs);
+            if (func && end)
+              {
+                struct item *it = add_item (exp, i_function, p1,
+                                            beg, end - beg);
+                it->func = func;
+                compile_function_args (it, openparen, end, nargs);
+                p = end;
+                break;
+              }
+
+            beg = p + 1;
+            end = func ? NULL : strchr (beg, closeparen);
+            if (end == NULL || lindex (beg, end, '$') != NULL)
+              {
+                /* Find the end of a computed name as expand_string_buf
+                   does.  If there's no end, or this is an unterminated
+                   reference, the rest of the string is its problem.  */
+                int count = 1;
+                if (end != NULL)
+                  for (p = beg; *p != '\0'; ++p)
+                    {
+                      if (*p == openparen)
+                        ++count;
+                      else if (*p == closeparen && --count == 0)
+                        break;
+                    }
+                if (end == NULL || count > 0)
+                  {
+                    add_item (exp, i_string, p1, p1, strlen (p1));
+                    return exp;
+                  }
+                add_item (exp, i_string, p1, p1, p - p1 + 1);
+                break;
+              }
+
+            p = end;
+
+            colon = lindex (beg, end, ':');
+            subst_end = colon ? lindex (colon + 1, end, '=') : NULL;
+            if (subst_end)
+              {
+                /* A substitution reference: $(FOO:A=B).  Keep the pattern
+                   and the replacement, each after an extra '%'.  */
+                const char *subst_beg = colon + 1;
+                const char *replace_beg = subst_end + 1;
+                size_t plen = subst_end - subst_beg;
+                size_t rlen = end - replace_beg;
+                struct item *it = add_item (exp, i_subst, p1,
+                                            beg, colon - beg);
+                char *pattern, *replace, *ppercent, *rpercent;
+
+                it->subst = xmalloc (plen + rlen + 4);
+                pattern = it->subst;
+                *(pattern++) = '%';
+                memcpy (pattern, subst_beg, plen);
+                pattern[plen] = '\0';
+                replace = pattern + plen + 1;
+                *(replace++) = '%';
+                memcpy (replace, replace_beg, rlen);
+                replace[rlen] = '\0';
+
+                prepare_subst (&pattern, &replace, &ppercent, &rpercent);
+                it->pattern = pattern;
+                it->replace = replace;
+                it->ppercent = ppercent;
+                it->rpercent = rpercent;
+              }
+            else
+              add_item (exp, i_variable, p1, beg, end - beg);
+          }
+          break;
+
+        default:
+          /* A $ followed by a random char is a variable reference.  */
+          add_item (exp, i_variable, p1, p, 1);
+          break;
+        }
+
+      if (*p == '\0')
+        break;
+
+      ++p;
+    }
+
+  return exp;
+}
+
+static void
+release_expansion (struct expansion *exp)
+{
+  unsigned int i, j;
+
+  if (--exp->refs > 0)
+    return;
+
+  for (i = 0; i < exp->count; ++i)
+    {
+      struct item *it = &exp->items[i];
+
+      if (it->args)
+        {
+          for (j = 0; j < it->nargs; ++j)
+            release_expansion (it->args[j]);
+          free (it->args);
+        }
+      free (it->argoffs);
+      free (it->subst);
+    }
+
+  free (exp->items);
+  free (exp->text);
+  free (exp);
+}
+
+/* Discard the compiled form of V's value, what we know of its size and
+   its words, and its environment string: it's being changed or freed.  */
+
+void
+forget_expansion (struct variable *v)
+{
+  if (v->compiled)
+    {
+      release_expansion (v->compiled);
+      v->compiled = NULL;
+    }
+  v->expanded = 0;
+  v->value_size = 0;
+  free (v->words);
+  v->words = NULL;
+  release_env_string (v->env);
+  v->env = NULL;
+}
+
+/* Return the variable named by the LENGTH chars at NAME if it's simple,
+   so that a reference to it expands to its value exactly.  */
+
+static struct variable *
+simple_variable (const char *name, size_t length)
+{
+  struct variable *v = lookup_variable (name, length);
+
+  if (v == NULL || v->recursive || v->special)
+    return NULL;
+
+  return v;
+}
+
+/* If the LENGTH chars at STRING are just a reference to a simple variable,
+   like "$(FOO)", return that variable.  Otherwise return NULL.  */
+
+struct variable *
+simple_variable_reference (const char *string, size_t length)
+{
+  const char *end = string + length - 1;
+  const char *p;
+
+  if (length < 4 || string[0] != '$'
+      || !((string[1] == '(' && *end == ')')
+           || (string[1] == '{' && *end == '}')))
+    return NULL;
+
+  for (p = string + 2; p < end; ++p)
+    if (ISSPACE (*p) || strchr ("$:(){},", *p) != NULL)
+      return NULL;
+
+  return simple_variable (string + 2, length - 3);
+}
+
+static char *expansion_output (char *o, struct expansion *exp);
+
+/* Call the function in IT, writing the result into the buffer at O.  */
+
+static char *
+function_call_output (char *o, const struct item *it)
+{
+  char **argv = alloca (sizeof (char *) * (it->nargs + 1));
+  char *abeg = NULL;
+  struct variable *list = NULL;
+  unsigned int i;
+
+  if (it->args)
+    for (i = 0; i < it->nargs; ++i)
+      {
+        const struct expansion *arg = it->args[i];
+        char *obuf;
+        size_t olen;
+
+        /* Pass a list of words in a simple variable without copying it.  */
+        if (i == it->nargs - 1 && function_takes_word_list (it->func)
+            && arg->count == 1 && arg->items[0].type == i_variable
+            && (list = simple_variable (arg->items[0].text,
+                                        arg->items[0].length)) != NULL)
+          {
+            argv[i] = list->value;
+            break;
+          }
+
+        install_variable_buffer (&obuf, &olen);
+        expansion_output (variable_buffer, it->args[i]);
+        argv[i] = swap_variable_buffer (obuf, olen);
+      }
+  else
+    {
+      abeg = xstrndup (it->text, it->length);
+      for (i = 0; i < it->nargs; ++i)
+        {
+          argv[i] = abeg + it->argoffs[i];
+          abeg[it->argoffs[i + 1] - 1] = '\0';
+        }
+    }
+  argv[it->nargs] = NULL;
+
+  o = expand_builtin_function (o, it->nargs, argv, it->func, list);
+
+  if (it->args)
+    {
+      for (i = 0; i < it->nargs; ++i)
+        if (list == NULL || argv[i] != list->value)
+          free (argv[i]);
+    }
+  else
+    free (abeg);
+
+  return o;
+}
+
+/* Interpret EXP, writing the result into the buffer at O.
+   Returns a pointer to the new end of the variable_buffer.  */
+
+static char *
+expansion_output (char *o, struct expansion *exp)
+{
+  unsigned int i;
+
+  /* The value might be reset while we're expanding it.  */
+  ++exp->refs;
+
+  for (i = 0; i < exp->count; ++i)
+    {
+      const struct item *it = &exp->items[i];
+
+      switch (it->type)
+        {
+        case i_text:
+          o = variable_buffer_output (o, it->text, it->length);
+          break;
+
+        case i_variable:
+          o = expand_variable_output (o, it->text, it->length);
+          break;
+
+        case i_subst:
+          o = subst_reference_output (o, it->text, it->length,
+                                      it->pattern, it->replace,
+                                      it->ppercent, it->rpercent);
+          break;
+
+        case i_function:
+          o = function_call_output (o, it);
+          break;
+
+        case i_string:
+          o = expand_string_buf (o, it->text, it->length);
+          o += strlen (o);
+          break;
+        }
+
+      /* Anything but text may have expanded a $(eval load ...) which
+         defined a new function.  Then some of the names we took for
+         variables might now be functions: do the rest the slow way.  */
+      if (it->type != i_text && exp->funcnum != function_changenum
+          && i + 1 < exp->count)
+        {
+          o = expand_string_buf (o, exp->items[i + 1].src, SIZE_MAX);
+          o += strlen (o);
+          break;
+        }
+    }
+
+  release_expansion (exp);
+
+  /* Functions don't always leave the buffer nul-terminated.  */
+  return variable_buffer_output (o, "", 0);
+}
+
+/* Expand the value of the recursive variable V into the buffer at O.
+   Returns a pointer to the new end of the variable_buffer.  */
+
+static char *
+variable_value_output (char *o, struct variable *v)
+{
+  if (v->compiled && v->compiled->funcnum != function_changenum)
+    forget_expansion (v);
+
+  if (!v->compiled)
+    {
+      /* Don't bother compiling values which are only expanded once, or
+         special variables which are updated behind our back.  */
+      if (!v->expanded || v->special)
+        {
+          v->expanded = 1;
+          if (*v->value == '\0')
+            return o;
+          o = expand_string_buf (o, v->value, strlen (v->value));
+          return o + strlen (o);
+        }
+      v->compiled = compile_expansion (v->value, strlen (v->value));
+    }
+
+  return expansion_output (o, v->compiled);
+}
+
+/* Like allocated_expand_string, for the value of the recursive variable V.  */
+
+static char *
+allocated_variable_value (struct variable *v)
+{
+  char *obuf;
+  size_t olen;
+
+  install_variable_buffer (&obuf, &olen);
+
+  variable_value_output (variable_buffer, v);
+
+  return swap_variable_buffer (obuf, olen);
+}
+
 /* Recursively expand V.  The returned string is malloc'd.  */
 
 static char *allocated_variable_append (const struct variable *v);
@@ -241,13 +772,13 @@ recursively_expand_for_file (struct variable *v, struct file *file)
        the env override value.
        User provided a command line definition or an env override.
        PARENT does not have an override directive, so ignore it.  */
-    value = allocated_expand_string (v->value);
+    value = allocated_variable_value (v);
   else if (v->append)
     /* Construct the value from its appended parts in the parent sets.  */
     value = allocated_variable_append (v);
   else
     /* A definition without appending.  */
-    value = allocated_expand_string (v->value);
+    value = allocated_variable_value (v);
   v->expanding = 0;
 
   if (set_reading)
@@ -373,7 +904,6 @@ allocated_expand_variable_for_file (const char *name, size_t length, struct file
 char *
 expand_string_buf (char *buf, const char *string, size_t length)
 {
-  struct variable *v;
   const char *p, *p1;
   char *save;
   char *o;
@@ -488,59 +1018,26 @@ expand_string_buf (char *buf, const char *string, size_t length)
                     const char *replace_beg = subst_end + 1;
                     const char *replace_end = end;
 
-                    /* Extract the variable name before the colon
-                       and look up that variable.  */
-                    v = lookup_variable (beg, colon - beg);
-                    if (v == 0)
-                      warn_undefined (beg, colon - beg);
-
-                    /* If the variable is not empty, perform the
-                       substitution.  */
-                    if (v != 0 && *v->value != '\0')
-                      {
-                        char *pattern, *replace, *ppercent, *rpercent;
-                        char *value = (v->recursive
-                                       ? recursively_expand (v)
-                                       : v->value);
-
-                        /* Copy the pattern and the replacement.  Add in an
-                           extra % at the beginning to use in case there
-                           isn't one in the pattern.  */
-                        pattern = alloca (subst_end - subst_beg + 2);
-                        *(pattern++) = '%';
-                        memcpy (pattern, subst_beg, subst_end - subst_beg);
-                        pattern[subst_end - subst_beg] = '\0';
-
-                        replace = alloca (replace_end - replace_beg + 2);
-                        *(replace++) = '%';
-                        memcpy (replace, replace_beg,
-                               replace_end - replace_beg);
-                        replace[replace_end - replace_beg] = '\0';
-
-                        /* Look for %.  Set the percent pointers properly
-                           based on whether we find one or not.  */
-                        ppercent = find_percent (pattern);
-                        if (ppercent)
-                          {
-                            ++ppercent;
-                            rpercent = find_percent (replace);
-                            if (rpercent)
-                              ++rpercent;
-                          }
-                        else
-                          {
-                            ppercent = pattern;
-                            rpercent = replace;
-                            --pattern;
-                            --replace;
-                          }
-
-                        o = patsubst_expand_pat (o, value, pattern, replace,
-                                                 ppercent, rpercent);
-
-                        if (v->recursive)
-                          free (value);
-                      }
+                    char *pattern, *replace, *ppercent, *rpercent;
+
+                    /* Copy the pattern and the replacement.  Add in an
+                       extra % at the beginning to use in case there
+                       isn't one in the pattern.  */
+                    pattern = alloca (subst_end - subst_beg + 2);
+                    *(pattern++) = '%';
+                    memcpy (pattern, subst_beg, subst_end - subst_beg);
+                    pattern[subst_end - subst_beg] = '\0';
+
+                    replace = alloca (replace_end - replace_beg + 2);
+                    *(replace++) = '%';
+                    memcpy (replace, replace_beg, replace_end - replace_beg);
+                    replace[replace_end - replace_beg] = '\0';
+
+                    prepare_subst (&pattern, &replace, &ppercent, &rpercent);
+
+                    o = subst_reference_output (o, beg, colon - beg,
+                                                pattern, replace,
+                                                ppercent, rpercent);
                   }
               }
 
@@ -656,7 +1153,7 @@ static char *
 variable_append (const char *name, size_t length,
                  const struct variable_set_list *set, int local)
 {
-  const struct variable *v;
+  struct variable *v;
   char *buf = 0;
   int nextlocal;
 
@@ -690,8 +1187,7 @@ variable_append (const char *name, size_t length,
   if (! v->recursive)
     return variable_buffer_output (buf, v->value, strlen (v->value));
 
-  buf = expand_string_buf (buf, v->value, strlen (v->value));
-  return (buf + strlen (buf));
+  return variable_value_output (buf, v);
 }
 
 
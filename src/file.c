@@ -38,12 +38,23 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
    only work on files which have not yet been snapped. */
 int snapped_deps = 0;
 
+/* Nonzero if the per-file part of snap_deps is put off until update_file
+   first reaches each file, because .LAZY_TARGETS is a target.  */
+int lazy_snap = 0;
+
+/* The global .EXTRA_PREREQS, kept for the files snapped lazily.  */
+static struct dep *lazy_extra_prereqs = NULL;
+
+/* Nonzero once snap_deps is done.  Files entered after that are never
+   snapped.  */
+static int snap_finished = 0;
+
 /* Hash table of files the makefile knows how to make.  */
 
 static unsigned long
 file_hash_1 (const void *key)
 {
-  return_ISTRING_HASH_1 (((struct file const *) key)->hname);
+  return_STABLE_ISTRING_HASH_1 (((struct file const *) key)->hname);
 }
 
 static unsigned long
@@ -147,9 +158,34 @@ lookup_file (const char *name)
   return f;
 }
 
+/* Like lookup_file, for a NAME in the strcache.  The strcache remembers its
+   hash, so NAME isn't hashed again.  */
+
+struct file *
+lookup_cached_file (const char *name)
+{
+  struct file file_key;
+  struct file **file_slot;
+
+#if MK_OS_VMS
+  return lookup_file (name);
+#else
+  assert (strcache_iscached (name));
+
+  if (name[0] == '.' && ISDIRSEP (name[1]) && name[2] != '\0')
+    return lookup_file (name);
+
+  file_key.hname = name;
+  file_slot = (struct file **) hash_find_slot_hash (&files, &file_key,
+                                                    strcache_hash (name));
+  return HASH_VACANT (*file_slot) ? NULL : *file_slot;
+#endif
+}
+
 /* Look up a file record for file NAME and return it.
    Create a new record if one doesn't exist.  NAME will be stored in the
-   new record so it should be constant or in the strcache etc.
+   new record, and its hash is kept in front of it, so it must be in the
+   strcache.
  */
 
 struct file *
@@ -161,7 +197,7 @@ enter_file (const char *name)
   struct file file_key;
 
   assert (*name != '\0');
-  assert (! verify_flag || strcache_iscached (name));
+  assert (strcache_iscached (name));
 
 #if MK_OS_VMS && !defined(WANT_CASE_SENSITIVE_TARGETS)
   if (*name != '.')
@@ -182,7 +218,8 @@ enter_file (const char *name)
 #endif
 
   file_key.hname = name;
-  file_slot = (struct file **) hash_find_slot (&files, &file_key);
+  file_slot = (struct file **) hash_find_slot_hash (&files, &file_key,
+                                                    strcache_hash (name));
   f = *file_slot;
   if (! HASH_VACANT (f) && !f->double_colon)
     {
@@ -190,9 +227,10 @@ enter_file (const char *name)
       return f;
     }
 
-  new = xcalloc (sizeof (struct file));
+  new = alloc_record (sizeof (struct file));
   new->name = new->hname = name;
   new->update_status = us_none;
+  new->snap_done = snap_finished;
 
   if (HASH_VACANT (f))
     {
@@ -559,7 +597,7 @@ enter_prereqs (struct dep *deps, const char *stem)
       if (d1->need_2nd_expansion)
         continue;
 
-      d1->file = lookup_file (d1->name);
+      d1->file = lookup_cached_file (d1->name);
       if (d1->file == 0)
         d1->file = enter_file (d1->name);
       d1->staticpattern = 0;
@@ -685,7 +723,7 @@ expand_deps (struct file *f)
       *dp = new;
       for (dp = &new, d = new; d != 0; dp = &d->next, d = d->next)
         {
-          d->file = lookup_file (d->name);
+          d->file = lookup_cached_file (d->name);
           if (d->file == 0)
             d->file = enter_file (d->name);
           d->name = 0;
@@ -715,7 +753,7 @@ expand_extra_prereqs (const struct variable *extra)
 
   for (d = prereqs; d; d = d->next)
     {
-      d->file = lookup_file (d->name);
+      d->file = lookup_cached_file (d->name);
       if (!d->file)
         d->file = enter_file (d->name);
       d->name = NULL;
@@ -725,15 +763,20 @@ expand_extra_prereqs (const struct variable *extra)
   return prereqs;
 }
 
-/* Perform per-file snap operations. */
+/* Perform per-file snap operations on F, the first entry for its name.
+   EXTRA is the global .EXTRA_PREREQS.  Return nonzero if F got new
+   prerequisites.  */
 
-static void
-snap_file (const void *item, void *arg)
+static int
+snap_one_file (struct file *f, struct dep *extra)
 {
-  struct file *f = (struct file*)item;
   struct dep *prereqs = NULL;
+  struct file *f2;
   struct dep *d;
 
+  for (f2 = f; f2 != 0; f2 = f2->prev)
+    f2->snap_done = 1;
+
   /* If we're not doing second expansion then reset updating.  */
   if (!second_expansion)
     f->updating = 0;
@@ -764,7 +807,7 @@ snap_file (const void *item, void *arg)
           }
     }
   else if (f->is_target)
-    prereqs = copy_dep_chain (arg);
+    prereqs = copy_dep_chain (extra);
 
   if (prereqs)
     {
@@ -774,8 +817,11 @@ snap_file (const void *item, void *arg)
           break;
 
       if (d)
-        /* We broke early: must have found a circular dependency.  */
-        free_dep_chain (prereqs);
+        {
+          /* We broke early: must have found a circular dependency.  */
+          free_dep_chain (prereqs);
+          return 0;
+        }
       else if (!f->deps)
         f->deps = prereqs;
       else
@@ -785,7 +831,62 @@ snap_file (const void *item, void *arg)
             d = d->next;
           d->next = prereqs;
         }
+      return 1;
     }
+
+  return 0;
+}
+
+static void
+snap_file (const void *item, void *arg)
+{
+  snap_one_file ((struct file *) item, arg);
+}
+
+/* Perform the per-file snap operations that snap_deps put off for FILE.
+   Called through snap_file_lazily as each file is first reached.  */
+
+void
+snap_file_deferred (struct file *file)
+{
+  struct file *f = file->double_colon ? file->double_colon : file;
+
+  if (!f->snap_done && snap_one_file (f, lazy_extra_prereqs))
+    /* As in expand_deps, regenerate '->shuf' to cover the new prereqs.  */
+    shuffle_deps_recursive (f->deps);
+}
+
+/* Lay out the prerequisites of each file next to each other.  The graph
+   rarely changes once it has been snapped, but it is walked while
+   updating, and prerequisites added by rules read at different times are
+   otherwise scattered all over memory.  */
+
+static void
+compact_deps (void)
+{
+  struct file **file_slot_0 = (struct file **) hash_dump (&files, NULL, NULL);
+  struct file **file_end = file_slot_0 + files.ht_fill;
+  struct file **file_slot;
+  struct dep ***chains;
+  unsigned int n = 0;
+  struct file *f;
+
+  for (file_slot = file_slot_0; file_slot < file_end; file_slot++)
+    for (f = *file_slot; f != 0; f = f->prev)
+      if (f->deps)
+        ++n;
+
+  chains = xmalloc (n * sizeof (struct dep **));
+  n = 0;
+  for (file_slot = file_slot_0; file_slot < file_end; file_slot++)
+    for (f = *file_slot; f != 0; f = f->prev)
+      if (f->deps)
+        chains[n++] = &f->deps;
+
+  compact_dep_chains (chains, n);
+
+  free (chains);
+  free (file_slot_0);
 }
 
 /* Mark the files depended on by .PRECIOUS, .PHONY, .SILENT,
@@ -916,15 +1017,30 @@ snap_deps (void)
                 d2->wait_here = 1;
     }
 
+  /* With .LAZY_TARGETS, files that are never reached while updating are
+     never snapped.  Dumping the database wants them all.  */
+  f = lookup_file (".LAZY_TARGETS");
+  lazy_snap = f != 0 && f->is_target
+              && !print_data_base_flag && !print_data_base_json_flag;
+
   {
     struct dep *prereqs = expand_extra_prereqs (lookup_variable (STRING_SIZE_TUPLE(".EXTRA_PREREQS")));
 
-    /* Perform per-file snap operations.  */
-    hash_map_arg(&files, snap_file, prereqs);
+    /* Perform per-file snap operations, now or as each file is reached.  */
+    if (lazy_snap)
+      lazy_extra_prereqs = prereqs;
+    else
+      {
+        hash_map_arg(&files, snap_file, prereqs);
+
+        free_dep_chain (prereqs);
 
-    free_dep_chain (prereqs);
+        compact_deps ();
+      }
   }
 
+  snap_finished = 1;
+
 #ifndef NO_MINUS_C_MINUS_O
   /* If .POSIX was defined, remove OUTPUT_OPTION to comply.  */
   /* This needs more work: what if the user sets this in the makefile?
@@ -1262,7 +1378,6 @@ verify_file (const void *item)
 
   VERIFY_CACHED (f, name);
   VERIFY_CACHED (f, hname);
-  VERIFY_CACHED (f, vpath);
   VERIFY_CACHED (f, stem);
 
   /* Check the deps.  */
@@ -28,44 +28,36 @@ struct variable_set_list;
 
 struct file
   {
+    /* The fields that update_file, check_dep and f_mtime look at for every
+       file, even one that is up to date, come first so that they share as
+       few cache lines as possible.  The rest are mostly used while reading
+       the makefiles or running recipes.  */
+
     const char *name;
-    const char *hname;          /* Hashed filename */
-    const char *vpath;          /* VPATH/vpath pathname */
     struct dep *deps;           /* all dependencies, including duplicates */
     struct commands *cmds;      /* Commands to execute for this target.  */
-    const char *stem;           /* Implicit stem, if an implicit
-                                   rule has been used */
-    struct dep *also_make;      /* Targets that are made by making this.  */
-    struct file *prev;          /* Previous entry for same file name;
-                                   used when there are multiple double-colon
-                                   entries for the same file.  */
-    struct file *last;          /* Last entry for the same file name.  */
 
     /* File that this file was renamed to.  After any time that a
        file could be renamed, call 'check_renamed' (below).  */
     struct file *renamed;
 
-    /* List of variable sets used for this file.  */
-    struct variable_set_list *variables;
+    struct file *prev;          /* Previous entry for same file name;
+                                   used when there are multiple double-colon
+                                   entries for the same file.  */
 
-    /* Pattern-specific variable reference for this target, or null if there
-       isn't one.  Also see the pat_searched flag, below.  */
-    struct variable_set_list *pat_variables;
+    /* For a double-colon entry, this is the first double-colon entry for
+       the same file.  Otherwise this is null.  */
+    struct file *double_colon;
+
+    struct dep *also_make;      /* Targets that are made by making this.  */
 
     /* Immediate dependent that caused this target to be remade,
        or nil if there isn't one.  */
     struct file *parent;
 
-    /* For a double-colon entry, this is the first double-colon entry for
-       the same file.  Otherwise this is null.  */
-    struct file *double_colon;
-
     FILE_TIMESTAMP last_mtime;  /* File's modtime, if already known.  */
-    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
-                                           has been performed.  */
     unsigned int considered;    /* equal to 'considered' if file has been
                                    considered on current scan of goal chain */
-    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
     enum update_status          /* Status of the last attempt to update.  */
       {
         us_success = 0,         /* Successfully updated.  Must be 0!  */
@@ -80,6 +72,7 @@ struct file
         cs_running,             /* Commands running.  */
         cs_finished             /* Commands finished.  */
       } command_state ENUM_BITFIELD (2);
+    unsigned int command_flags:3; /* Flags OR'd in for cmds; see commands.h. */
 
     unsigned int builtin:1;     /* True if the file is a builtin rule. */
     unsigned int precious:1;    /* Non-0 means don't delete file on quit */
@@ -111,9 +104,27 @@ struct file
                                    diagnostics has been issued (dontcare). */
     unsigned int was_shuffled:1; /* Did we already shuffle 'deps'? used when
                                     --shuffle passes through the graph.  */
+    unsigned int snap_done:1;   /* True if snap_deps has handled this file;
+                                   see .LAZY_TARGETS.  */
     unsigned int snapped:1;     /* True if the deps of this file have been
                                    secondary expanded.  */
+    unsigned int prefetch_seen:1; /* True if prefetch_mtimes has been here.  */
     unsigned int suffix:1;      /* True if this is a suffix rule. */
+
+    const char *hname;          /* Hashed filename */
+    const char *stem;           /* Implicit stem, if an implicit
+                                   rule has been used */
+    struct file *last;          /* Last entry for the same file name.  */
+
+    /* List of variable sets used for this file.  */
+    struct variable_set_list *variables;
+
+    /* Pattern-specific variable reference for this target, or null if there
+       isn't one.  Also see the pat_searched flag, above.  */
+    struct variable_set_list *pat_variables;
+
+    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
+                                           has been performed.  */
   };
 
 
@@ -121,6 +132,7 @@ extern struct file *default_file;
 
 
 struct file *lookup_file (const char *name);
+struct file *lookup_cached_file (const char *name);
 struct file *enter_file (const char *name);
 struct dep *split_prereqs (char *prereqstr);
 struct dep *enter_prereqs (struct dep *prereqs, const char *stem);
@@ -128,6 +140,7 @@ void expand_deps (struct file *f);
 struct dep *expand_extra_prereqs (const struct variable *extra);
 void remove_intermediates (int sig);
 void snap_deps (void);
+void snap_file_deferred (struct file *f);
 void rename_file (struct file *file, const char *name);
 void rehash_file (struct file *file, const char *name);
 void set_command_state (struct file *file, enum cmd_state state);
@@ -228,4 +241,11 @@ FILE_TIMESTAMP f_mtime (struct file *file, int search);
 
 /* Have we snapped deps yet?  */
 extern int snapped_deps;
+
+/* Nonzero if snap_deps left the files for update_file to snap as it first
+   reaches each of them: see .LAZY_TARGETS.  */
+extern int lazy_snap;
+
+#define snap_file_lazily(_f) \
+  do { if (lazy_snap && !(_f)->snap_done) snap_file_deferred (_f); } while (0)
 struct hash_table *get_files(void);
@@ -22,6 +22,8 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "os.h"
 #include "commands.h"
 #include "debug.h"
+#include "shcache.h"
+#include "sha1.h"
 
 
 struct function_table_entry
@@ -35,6 +37,7 @@ struct function_table_entry
     unsigned char minimum_args;
     unsigned char maximum_args;
     unsigned int expand_args:1;
+    unsigned int pure:1;
     unsigned int alloc_fn:1;
     unsigned int adds_command:1;
   };
@@ -65,6 +68,13 @@ function_table_entry_hash_cmp (const void *xv, const void *yv)
 }
 
 static struct hash_table function_table;
+
+/* Incremented whenever a function is defined, so that compiled expansions
+   can tell that a name they took for a variable might now be a function.  */
+unsigned long function_changenum = 0;
+
+/* Incremented whenever prerequisites are added to .PURE.  */
+unsigned long pure_changenum = 0;
 
 
 /* Store into VARIABLE_BUFFER at O the result of scanning TEXT and replacing
@@ -387,7 +397,7 @@ string_glob (char *line)
 
       /* Because we used PARSEFS_NOCACHE above, we have to free() NAME.  */
       free ((char *)chain->name);
-      free (chain);
+      free_ns (chain);
       chain = next;
     }
 
@@ -697,13 +707,75 @@ func_subst (char *o, char **argv, const char *funcname UNUSED)
 }
 
 
+/* Where the words are in the value of a simple variable.  When the list
+   argument of words, word, wordlist, firstword or lastword is a reference to
+   a simple variable, the variable's value is passed as the argument and
+   these are found once, rather than on each call.  */
+
+struct word_index
+  {
+    size_t count;               /* Number of words.  */
+    size_t *bounds;             /* Offsets of the start and end of each.  */
+  };
+
+/* The index of the list argument of the function being called, or NULL.  */
+
+static const struct word_index *list_words;
+
+/* Return the word index of V's value, making it if need be.  */
+
+static const struct word_index *
+variable_words (struct variable *v)
+{
+  if (v->words == NULL)
+    {
+      const char *list = v->value;
+      const char *p;
+      size_t count = 0;
+      size_t len;
+      size_t *b;
+
+      while (find_next_token (&list, NULL) != 0)
+        ++count;
+
+      v->words = xmalloc (sizeof (struct word_index)
+                          + count * 2 * sizeof (size_t));
+      v->words->count = count;
+      v->words->bounds = b = (size_t *) (v->words + 1);
+
+      list = v->value;
+      while ((p = find_next_token (&list, &len)) != 0)
+        {
+          *(b++) = p - v->value;
+          *(b++) = p - v->value + len;
+        }
+    }
+
+  return v->words;
+}
+
+/* Write words FIRST to LAST of LIST, counting from 0, using LIST_WORDS.  */
+
+static char *
+list_words_output (char *o, const char *list, size_t first, size_t last)
+{
+  const size_t *b = list_words->bounds;
+
+  return variable_buffer_output (o, list + b[2 * first],
+                                 b[2 * last + 1] - b[2 * first]);
+}
+
 static char *
 func_firstword (char *o, char **argv, const char *funcname UNUSED)
 {
   size_t i;
   const char *words = argv[0];    /* Use a temp variable for find_next_token */
-  const char *p = find_next_token (&words, &i);
+  const char *p;
+
+  if (list_words)
+    return list_words->count ? list_words_output (o, argv[0], 0, 0) : o;
 
+  p = find_next_token (&words, &i);
   if (p != 0)
     o = variable_buffer_output (o, p, i);
 
@@ -718,6 +790,12 @@ func_lastword (char *o, char **argv, const char *funcname UNUSED)
   const char *p = NULL;
   const char *t;
 
+  if (list_words)
+    {
+      size_t n = list_words->count;
+      return n ? list_words_output (o, argv[0], n - 1, n - 1) : o;
+    }
+
   while ((t = find_next_token (&words, &i)) != NULL)
     p = t;
 
@@ -734,8 +812,11 @@ func_words (char *o, char **argv, const char *funcname UNUSED)
   const char *word_iterator = argv[0];
   char buf[INTSTR_LENGTH];
 
-  while (find_next_token (&word_iterator, NULL) != 0)
-    ++i;
+  if (list_words)
+    i = (unsigned int) list_words->count;
+  else
+    while (find_next_token (&word_iterator, NULL) != 0)
+      ++i;
 
   o = variable_buffer_output (o, buf, sprintf (buf, "%u", i));
 
@@ -793,6 +874,13 @@ func_word (char *o, char **argv, const char *funcname UNUSED)
     O (fatal, *expanding_var,
        _("first argument to 'word' function must be greater than 0"));
 
+  if (list_words)
+    {
+      if ((unsigned long long) i <= list_words->count)
+        o = list_words_output (o, argv[1], i - 1, i - 1);
+      return o;
+    }
+
   end_p = argv[1];
   while ((p = find_next_token (&end_p, 0)) != 0)
     if (--i == 0)
@@ -822,7 +910,15 @@ func_wordlist (char *o, char **argv, const char *funcname UNUSED)
 
   count = stop - start + 1;
 
-  if (count > 0)
+  if (count > 0 && list_words)
+    {
+      size_t n = list_words->count;
+
+      if ((unsigned long long) start <= n)
+        o = list_words_output (o, argv[2], start - 1,
+                               (unsigned long long) stop < n ? stop - 1 : n - 1);
+    }
+  else if (count > 0)
     {
       const char *p;
       const char *end_p = argv[2];
@@ -881,6 +977,7 @@ func_foreach (char *o, char **argv, const char *funcname UNUSED)
     {
       char *result = 0;
 
+      forget_expansion (var);
       free (var->value);
       var->value = xstrndup (p, len);
 
@@ -1526,6 +1623,295 @@ func_wildcard (char *o, char **argv, const char *funcname UNUSED)
    return o;
 }
 
+/* Filesystem functions.
+
+   These do the jobs makefiles most often fork a shell for: finding files,
+   testing whether they exist, and getting their times, sizes, contents and
+   digests.  Names are looked up through the directory cache where that's
+   possible.  Names which don't exist are left out of the results.  */
+
+/* Write each name matching PATTERN to the buffer at O, followed by a space.
+   PATTERN is glob-expanded using the directory cache, except that a "**"
+   path component matches any number of directories, including none.  If
+   "**" is the last component it matches every name below the directory.
+   Symbolic links to directories aren't followed by "**".  */
+
+static char *
+glob_output (char *o, const char *pattern)
+{
+  const char *ss = pattern;
+  glob_t gl;
+  size_t i;
+
+  /* Find the first "**" component.  */
+  while ((ss = strstr (ss, "**")) != NULL)
+    if ((ss == pattern || ss[-1] == '/') && (ss[2] == '/' || ss[2] == '\0'))
+      break;
+    else
+      ss += 2;
+
+  dir_setup_glob (&gl);
+
+  if (ss == NULL)
+    {
+      if (glob (pattern, GLOB_ALTDIRFUNC, NULL, &gl) == 0)
+        {
+          for (i = 0; i < gl.gl_pathc; ++i)
+            {
+              o = variable_buffer_output (o, gl.gl_pathv[i],
+                                          strlen (gl.gl_pathv[i]));
+              o = variable_buffer_output (o, " ", 1);
+            }
+          globfree (&gl);
+        }
+      return o;
+    }
+  else
+    {
+      /* DIR is everything before the "**", including its slash, and AFTER
+         everything following it.  Match the rest of the pattern in DIR, then
+         in each of its subdirectories.  */
+      char *dir = xstrndup (pattern, ss - pattern);
+      char *after = xstrdup (ss + 2);
+      char *sub = xstrdup (concat (2, dir, after[0] ? after + 1 : "*"));
+      char *subdirs = xstrdup (concat (2, dir, "*/"));
+
+      o = glob_output (o, sub);
+
+      if (glob (subdirs, GLOB_ALTDIRFUNC, NULL, &gl) == 0)
+        {
+          for (i = 0; i < gl.gl_pathc; ++i)
+            {
+              const char *d = gl.gl_pathv[i];
+              char *name = xstrndup (d, strlen (d) - 1);
+              struct stat st;
+              int r;
+
+              EINTRLOOP (r, lstat (name, &st));
+              free (name);
+              if (r != 0 || !S_ISDIR (st.st_mode))
+                continue;
+
+              /* D ends with a slash, so it can be a prefix as DIR is.  */
+              name = xstrdup (concat (3, d, "**", after));
+              o = glob_output (o, name);
+              free (name);
+            }
+          globfree (&gl);
+        }
+
+      free (after);
+      free (subdirs);
+      free (sub);
+      free (dir);
+      return o;
+    }
+}
+
+static char *
+func_file_glob (char *o, char **argv, const char *funcname UNUSED)
+{
+  const char *list = argv[0];
+  const char *p;
+  size_t len;
+  int doneany = 0;
+
+  while ((p = find_next_token (&list, &len)) != 0)
+    {
+      char *pattern = xstrndup (p, len);
+      char *start = o;
+
+      o = glob_output (o, pattern);
+      doneany |= o != start;
+      free (pattern);
+    }
+
+  /* Kill last space.  */
+  if (doneany)
+    --o;
+
+  return o;
+}
+
+static char *
+func_file_exists (char *o, char **argv, const char *funcname UNUSED)
+{
+  const char *list = argv[0];
+  const char *p;
+  size_t len;
+  int doneany = 0;
+
+  while ((p = find_next_token (&list, &len)) != 0)
+    {
+      char *name = xstrndup (p, len);
+
+      if (file_exists_p (name))
+        {
+          o = variable_buffer_output (o, p, len);
+          o = variable_buffer_output (o, " ", 1);
+          doneany = 1;
+        }
+      free (name);
+    }
+
+  /* Kill last space.  */
+  if (doneany)
+    --o;
+
+  return o;
+}
+
+/* Implement $(file-mtime ...) and $(file-size ...): write the modification
+   time in seconds, or the size in bytes, of each existing file.  */
+
+static char *
+func_file_stat (char *o, char **argv, const char *funcname)
+{
+  int want_size = streq (funcname, "file-size");
+  const char *list = argv[0];
+  const char *p;
+  size_t len;
+  int doneany = 0;
+
+  while ((p = find_next_token (&list, &len)) != 0)
+    {
+      char *name = xstrndup (p, len);
+      char buf[INTSTR_LENGTH];
+      struct stat st;
+      int r;
+
+      EINTRLOOP (r, stat (name, &st));
+      if (r == 0)
+        {
+          if (want_size)
+            sprintf (buf, "%" PRIdMAX, (intmax_t) st.st_size);
+          else
+            sprintf (buf, "%" PRIdMAX, (intmax_t) st.st_mtime);
+          o = variable_buffer_output (o, buf, strlen (buf));
+          o = variable_buffer_output (o, " ", 1);
+          doneany = 1;
+        }
+      free (name);
+    }
+
+  /* Kill last space.  */
+  if (doneany)
+    --o;
+
+  return o;
+}
+
+/* Open the file named by the LEN chars at P for reading.  Return NULL if it
+   doesn't exist, and fail if it can't be opened.  NAME is set to the name,
+   which must be freed.  */
+
+static FILE *
+open_named_file (const char *p, size_t len, char **name)
+{
+  FILE *fp;
+
+  *name = xstrndup (p, len);
+  ENULLLOOP (fp, fopen (*name, "rb"));
+  if (fp == NULL)
+    {
+      if (errno == ENOENT)
+        DB (DB_VERBOSE, (_("%s: Failed to open '%s': %s\n"),
+                         "file", *name, strerror (errno)));
+      else
+        OSS (fatal, reading_file, _("open: %s: %s"), *name, strerror (errno));
+    }
+  return fp;
+}
+
+static void fold_newlines (char *buffer, size_t *length, int trim_newlines);
+
+/* $(file-read NAMES): the contents of each file, as $(shell cat NAMES) would
+   give them, with newlines converted to spaces.  */
+
+static char *
+func_file_read (char *o, char **argv, const char *funcname UNUSED)
+{
+  const char *list = argv[0];
+  size_t start = o - variable_buffer;
+  const char *p;
+  size_t len;
+
+  while ((p = find_next_token (&list, &len)) != 0)
+    {
+      char *name;
+      FILE *fp = open_named_file (p, len, &name);
+
+      if (fp != NULL)
+        {
+          char buf[8192];
+          size_t l;
+
+          while ((l = fread (buf, 1, sizeof (buf), fp)) > 0)
+            o = variable_buffer_output (o, buf, l);
+          if (ferror (fp))
+            OSS (fatal, reading_file, _("read: %s: %s"), name, strerror (errno));
+          fclose (fp);
+        }
+      free (name);
+    }
+
+  len = o - variable_buffer - start;
+  fold_newlines (variable_buffer + start, &len, 1);
+  return variable_buffer + start + len;
+}
+
+/* $(file-hash NAMES): the SHA-1 digest of each file, in hex.  */
+
+static char *
+func_file_hash (char *o, char **argv, const char *funcname UNUSED)
+{
+  const char *list = argv[0];
+  const char *p;
+  size_t len;
+  int doneany = 0;
+
+  while ((p = find_next_token (&list, &len)) != 0)
+    {
+      char *name;
+      FILE *fp = open_named_file (p, len, &name);
+
+      if (fp != NULL)
+        {
+          static const char hex[] = "0123456789abcdef";
+          unsigned char digest[SHA1_DIGEST_SIZE];
+          char out[SHA1_DIGEST_SIZE * 2];
+          struct sha1_ctx ctx;
+          char buf[8192];
+          size_t l;
+          int i;
+
+          sha1_init (&ctx);
+          while ((l = fread (buf, 1, sizeof (buf), fp)) > 0)
+            sha1_update (&ctx, buf, l);
+          if (ferror (fp))
+            OSS (fatal, reading_file, _("read: %s: %s"), name, strerror (errno));
+          fclose (fp);
+          sha1_final (&ctx, digest);
+
+          for (i = 0; i < SHA1_DIGEST_SIZE; ++i)
+            {
+              out[2 * i] = hex[digest[i] >> 4];
+              out[2 * i + 1] = hex[digest[i] & 0xf];
+            }
+          o = variable_buffer_output (o, out, sizeof (out));
+          o = variable_buffer_output (o, " ", 1);
+          doneany = 1;
+        }
+      free (name);
+    }
+
+  /* Kill last space.  */
+  if (doneany)
+    --o;
+
+  return o;
+}
+
 /*
   $(eval <makefile string>)
 
@@ -1821,6 +2207,7 @@ func_shell_base (char *o, char **argv, int trim_newlines)
 }
 
 #define func_shell 0
+#define func_shell_cached 0
 
 #else
 char *
@@ -2001,6 +2388,138 @@ func_shell (char *o, char **argv, const char *funcname UNUSED)
 {
   return func_shell_base (o, argv, 1);
 }
+
+/* Append the LEN bytes of S to the buffer *BUFP, which holds *LENP bytes and
+   has room for *SIZEP.  */
+
+static void
+append_bytes (char **bufp, size_t *lenp, size_t *sizep,
+              const void *s, size_t len)
+{
+  if (*lenp + len > *sizep)
+    {
+      *sizep = (*lenp + len) * 2;
+      *bufp = xrealloc (*bufp, *sizep);
+    }
+  memcpy (*bufp + *lenp, s, len);
+  *lenp += len;
+}
+
+/* Append the MAKEFLAGS or MFLAGS environment entry ENTRY to the buffer,
+   without the --jobserver-auth option: under -j it names a pipe or FIFO
+   which differs from one run of make to the next, but it doesn't change
+   what a command prints.  */
+
+static void
+append_makeflags (char **bufp, size_t *lenp, size_t *sizep, const char *entry)
+{
+  const char *opt = "--" JOBSERVER_AUTH_OPT "=";
+  const char *p = entry;
+  const char *s;
+
+  while ((s = strstr (p, opt)) != NULL)
+    {
+      append_bytes (bufp, lenp, sizep, p, s - p);
+      p = s;
+      while (*p != '\0' && !ISSPACE (*p))
+        ++p;
+    }
+  append_bytes (bufp, lenp, sizep, p, strlen (p) + 1);
+}
+
+static int
+env_cmp (const void *x, const void *y)
+{
+  return strcmp (*(char *const *) x, *(char *const *) y);
+}
+
+/* $(shell-cached FILES,COMMAND): like $(shell COMMAND), but if COMMAND
+   succeeds its output is kept in the shell cache.  Later calls, in this or
+   any other run of make, reuse the output without running COMMAND as long as
+   the directory, the shell, the exported environment (apart from the
+   jobserver) and the modification times of FILES haven't changed.  */
+
+static char *
+func_shell_cached (char *o, char **argv, const char *funcname UNUSED)
+{
+  char *shell = allocated_expand_variable (STRING_SIZE_TUPLE ("SHELL"));
+  char *flags = allocated_expand_variable (STRING_SIZE_TUPLE (".SHELLFLAGS"));
+  size_t keylen = 0, keysize = 256;
+  size_t statelen = 0, statesize = 1024;
+  char *key = xmalloc (keysize);
+  char *state = xmalloc (statesize);
+  const char *list = argv[0];
+  const char *output;
+  const char *p;
+  char **env, **ep;
+  size_t len;
+
+  /* The key identifies the command.  */
+  append_bytes (&key, &keylen, &keysize,
+                starting_directory, strlen (starting_directory) + 1);
+  append_bytes (&key, &keylen, &keysize, shell, strlen (shell) + 1);
+  append_bytes (&key, &keylen, &keysize, flags, strlen (flags) + 1);
+  append_bytes (&key, &keylen, &keysize, argv[1], strlen (argv[1]) + 1);
+  free (shell);
+  free (flags);
+
+  /* The state is everything else its output depends on: the environment
+     it would run in, and the modification times of its input files.  */
+  env = target_environment (NULL, 0);
+  for (len = 0; env[len] != NULL; ++len)
+    ;
+  qsort (env, len, sizeof (char *), env_cmp);
+  for (ep = env; *ep != NULL; ++ep)
+    if (strneq (*ep, "MAKEFLAGS=", CSTRLEN ("MAKEFLAGS="))
+        || strneq (*ep, "MFLAGS=", CSTRLEN ("MFLAGS=")))
+      append_makeflags (&state, &statelen, &statesize, *ep);
+    else
+      append_bytes (&state, &statelen, &statesize, *ep, strlen (*ep) + 1);
+  free_target_environment (env);
+
+  while ((p = find_next_token (&list, &len)) != NULL)
+    {
+      char *name = xstrndup (p, len);
+      FILE_TIMESTAMP mtime = NONEXISTENT_MTIME;
+      struct stat st;
+      int r;
+
+      EINTRLOOP (r, stat (name, &st));
+      if (r == 0)
+        mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
+
+      append_bytes (&state, &statelen, &statesize, name, len + 1);
+      append_bytes (&state, &statelen, &statesize, &mtime, sizeof (mtime));
+      free (name);
+    }
+
+  output = shcache_find (key, keylen, state, statelen, &len);
+  if (output)
+    {
+      DB (DB_VERBOSE, (_("Using cached output of shell command: %s\n"),
+                       argv[1]));
+      shell_completed (0, 0);
+      o = variable_buffer_output (o, output, len);
+    }
+  else
+    {
+      size_t off = o - variable_buffer;
+      struct variable *v;
+
+      o = func_shell_base (o, argv + 1, 1);
+
+      /* Only remember the output of commands that succeeded.  */
+      v = lookup_variable (STRING_SIZE_TUPLE (".SHELLSTATUS"));
+      if (v && streq (v->value, "0"))
+        shcache_store (key, keylen, state, statelen,
+                       variable_buffer + off, o - variable_buffer - off);
+    }
+
+  free (key);
+  free (state);
+
+  return o;
+}
 #endif  /* !MK_OS_VMS */
 
 #ifdef EXPERIMENTAL
@@ -2384,66 +2903,279 @@ func_abspath (char *o, char **argv, const char *funcname UNUSED)
 
    EXPAND_ARGS means that all arguments should be expanded before invocation.
    Functions that do namespace tricks (foreach, let) don't automatically
-   expand.  */
+   expand.
+
+   PURE means that the result depends on nothing but the arguments, so it's
+   worth remembering.  */
 
 static char *func_call (char *o, char **argv, const char *funcname);
 
-#define FT_ENTRY(_name, _min, _max, _exp, _func) \
-  { { (_func) }, STRING_SIZE_TUPLE(_name), (_min), (_max), (_exp), 0, 0 }
+#define FT_ENTRY(_name, _min, _max, _exp, _pure, _func) \
+  { { (_func) }, STRING_SIZE_TUPLE(_name), (_min), (_max), (_exp), (_pure), 0, 0 }
 
 static const struct function_table_entry function_table_init[] =
 {
- /*         Name            MIN MAX EXP? Function */
-  FT_ENTRY ("abspath",       0,  1,  1,  func_abspath),
-  FT_ENTRY ("addprefix",     2,  2,  1,  func_addsuffix_addprefix),
-  FT_ENTRY ("addsuffix",     2,  2,  1,  func_addsuffix_addprefix),
-  FT_ENTRY ("and",           1,  0,  0,  func_and),
-  FT_ENTRY ("basename",      0,  1,  1,  func_basename_dir),
-  FT_ENTRY ("call",          1,  0,  1,  func_call),
-  FT_ENTRY ("dir",           0,  1,  1,  func_basename_dir),
-  FT_ENTRY ("error",         0,  1,  1,  func_error),
-  FT_ENTRY ("eval",          0,  1,  1,  func_eval),
-  FT_ENTRY ("file",          1,  2,  1,  func_file),
-  FT_ENTRY ("filter",        2,  2,  1,  func_filter_filterout),
-  FT_ENTRY ("filter-out",    2,  2,  1,  func_filter_filterout),
-  FT_ENTRY ("findstring",    2,  2,  1,  func_findstring),
-  FT_ENTRY ("firstword",     0,  1,  1,  func_firstword),
-  FT_ENTRY ("flavor",        0,  1,  1,  func_flavor),
-  FT_ENTRY ("foreach",       3,  3,  0,  func_foreach),
-  FT_ENTRY ("if",            2,  3,  0,  func_if),
-  FT_ENTRY ("info",          0,  1,  1,  func_error),
-  FT_ENTRY ("intcmp",        2,  5,  0,  func_intcmp),
-  FT_ENTRY ("join",          2,  2,  1,  func_join),
-  FT_ENTRY ("lastword",      0,  1,  1,  func_lastword),
-  FT_ENTRY ("let",           3,  3,  0,  func_let),
-  FT_ENTRY ("notdir",        0,  1,  1,  func_notdir_suffix),
-  FT_ENTRY ("or",            1,  0,  0,  func_or),
-  FT_ENTRY ("origin",        0,  1,  1,  func_origin),
-  FT_ENTRY ("patsubst",      3,  3,  1,  func_patsubst),
-  FT_ENTRY ("realpath",      0,  1,  1,  func_realpath),
-  FT_ENTRY ("shell",         0,  1,  1,  func_shell),
-  FT_ENTRY ("sort",          0,  1,  1,  func_sort),
-  FT_ENTRY ("strip",         0,  1,  1,  func_strip),
-  FT_ENTRY ("subst",         3,  3,  1,  func_subst),
-  FT_ENTRY ("suffix",        0,  1,  1,  func_notdir_suffix),
-  FT_ENTRY ("value",         0,  1,  1,  func_value),
-  FT_ENTRY ("warning",       0,  1,  1,  func_error),
-  FT_ENTRY ("wildcard",      0,  1,  1,  func_wildcard),
-  FT_ENTRY ("word",          2,  2,  1,  func_word),
-  FT_ENTRY ("wordlist",      3,  3,  1,  func_wordlist),
-  FT_ENTRY ("words",         0,  1,  1,  func_words),
+ /*         Name            MIN MAX EXP? PURE? Function */
+  FT_ENTRY ("abspath",       0,  1,  1,  1,  func_abspath),
+  FT_ENTRY ("addprefix",     2,  2,  1,  1,  func_addsuffix_addprefix),
+  FT_ENTRY ("addsuffix",     2,  2,  1,  1,  func_addsuffix_addprefix),
+  FT_ENTRY ("and",           1,  0,  0,  0,  func_and),
+  FT_ENTRY ("basename",      0,  1,  1,  1,  func_basename_dir),
+  FT_ENTRY ("call",          1,  0,  1,  0,  func_call),
+  FT_ENTRY ("dir",           0,  1,  1,  1,  func_basename_dir),
+  FT_ENTRY ("error",         0,  1,  1,  0,  func_error),
+  FT_ENTRY ("eval",          0,  1,  1,  0,  func_eval),
+  FT_ENTRY ("file",          1,  2,  1,  0,  func_file),
+  FT_ENTRY ("file-exists",   0,  1,  1,  0,  func_file_exists),
+  FT_ENTRY ("file-glob",     0,  1,  1,  0,  func_file_glob),
+  FT_ENTRY ("file-hash",     0,  1,  1,  0,  func_file_hash),
+  FT_ENTRY ("file-mtime",    0,  1,  1,  0,  func_file_stat),
+  FT_ENTRY ("file-read",     0,  1,  1,  0,  func_file_read),
+  FT_ENTRY ("file-size",     0,  1,  1,  0,  func_file_stat),
+  FT_ENTRY ("filter",        2,  2,  1,  1,  func_filter_filterout),
+  FT_ENTRY ("filter-out",    2,  2,  1,  1,  func_filter_filterout),
+  FT_ENTRY ("findstring",    2,  2,  1,  0,  func_findstring),
+  FT_ENTRY ("firstword",     0,  1,  1,  0,  func_firstword),
+  FT_ENTRY ("flavor",        0,  1,  1,  0,  func_flavor),
+  FT_ENTRY ("foreach",       3,  3,  0,  0,  func_foreach),
+  FT_ENTRY ("if",            2,  3,  0,  0,  func_if),
+  FT_ENTRY ("info",          0,  1,  1,  0,  func_error),
+  FT_ENTRY ("intcmp",        2,  5,  0,  0,  func_intcmp),
+  FT_ENTRY ("join",          2,  2,  1,  1,  func_join),
+  FT_ENTRY ("lastword",      0,  1,  1,  0,  func_lastword),
+  FT_ENTRY ("let",           3,  3,  0,  0,  func_let),
+  FT_ENTRY ("notdir",        0,  1,  1,  1,  func_notdir_suffix),
+  FT_ENTRY ("or",            1,  0,  0,  0,  func_or),
+  FT_ENTRY ("origin",        0,  1,  1,  0,  func_origin),
+  FT_ENTRY ("patsubst",      3,  3,  1,  1,  func_patsubst),
+  FT_ENTRY ("realpath",      0,  1,  1,  0,  func_realpath),
+  FT_ENTRY ("shell",         0,  1,  1,  0,  func_shell),
+  FT_ENTRY ("shell-cached",  2,  2,  1,  0,  func_shell_cached),
+  FT_ENTRY ("sort",          0,  1,  1,  1,  func_sort),
+  FT_ENTRY ("strip",         0,  1,  1,  0,  func_strip),
+  FT_ENTRY ("subst",         3,  3,  1,  1,  func_subst),
+  FT_ENTRY ("suffix",        0,  1,  1,  1,  func_notdir_suffix),
+  FT_ENTRY ("value",         0,  1,  1,  0,  func_value),
+  FT_ENTRY ("warning",       0,  1,  1,  0,  func_error),
+  FT_ENTRY ("wildcard",      0,  1,  1,  0,  func_wildcard),
+  FT_ENTRY ("word",          2,  2,  1,  0,  func_word),
+  FT_ENTRY ("wordlist",      3,  3,  1,  0,  func_wordlist),
+  FT_ENTRY ("words",         0,  1,  1,  0,  func_words),
 #ifdef EXPERIMENTAL
-  FT_ENTRY ("eq",            2,  2,  1,  func_eq),
-  FT_ENTRY ("not",           0,  1,  1,  func_not),
+  FT_ENTRY ("eq",            2,  2,  1,  0,  func_eq),
+  FT_ENTRY ("not",           0,  1,  1,  0,  func_not),
 #endif
 };
 
 
+/* Memoization of pure functions.
+
+   Makefiles tend to call functions with the same arguments over and over,
+   for example to compute the object file names from a list of sources in
+   each recipe.  Remember the results of recent calls to the builtin functions
+   marked PURE, and to user-defined functions which are prerequisites of the
+   special target .PURE.  When the cache fills up it's simply emptied.  */
+
+#define MEMO_MAX_ENTRIES  4096
+#define MEMO_MAX_SIZE     (16 * 1024 * 1024)
+
+struct memo
+  {
+    const void *fn;             /* Function table entry, or for call an
+                                   element of call_flavors.  */
+    unsigned long hash;         /* Hash of KEY.  */
+    size_t keylen;              /* Length of KEY.  */
+    size_t reslen;              /* Length of RESULT.  */
+    const char *key;            /* Each argument followed by a nul.  */
+    const char *result;         /* The result of the call.  */
+  };
+
+/* A simple and a recursive function can have the same value but give
+   different results, so calls to them are told apart by these.  */
+static const char call_flavors[2];
+
+static struct hash_table memo_table;
+static size_t memo_size;
+static unsigned long memo_hits;
+static unsigned long memo_misses;
+static unsigned long memo_flushes;
+
+static unsigned long
+memo_hash_1 (const void *keyv)
+{
+  const struct memo *key = keyv;
+  return key->hash;
+}
+
+static unsigned long
+memo_hash_2 (const void *keyv)
+{
+  const struct memo *key = keyv;
+  return key->hash >> 16;
+}
+
+static int
+memo_hash_cmp (const void *xv, const void *yv)
+{
+  const struct memo *x = xv;
+  const struct memo *y = yv;
+
+  if (x->fn != y->fn)
+    return x->fn < y->fn ? -1 : 1;
+  if (x->keylen != y->keylen)
+    return x->keylen < y->keylen ? -1 : 1;
+  return memcmp (x->key, y->key, x->keylen);
+}
+
+/* Set up KEY to look for a call of FN with ARGC arguments in ARGV, preceded
+   by PREFIX if it's not NULL.  The key is allocated and must be freed.  */
+
+static void
+memo_key (struct memo *key, const void *fn, const char *prefix,
+          unsigned int argc, char **argv)
+{
+  size_t len = prefix ? strlen (prefix) + 1 : 0;
+  unsigned int i;
+  char *p;
+
+  for (i = 0; i < argc; ++i)
+    len += strlen (argv[i]) + 1;
+
+  key->key = p = xmalloc (len);
+  if (prefix)
+    p = stpcpy (p, prefix) + 1;
+  for (i = 0; i < argc; ++i)
+    p = stpcpy (p, argv[i]) + 1;
+
+  key->fn = fn;
+  key->keylen = len;
+  key->hash = jhash ((const unsigned char *) key->key, (int) len);
+}
+
+/* Look for a call matching KEY.  If there is one, write its result into the
+   buffer at *OP, updating *OP, and return nonzero.  */
+
+static int
+memo_find (char **op, const struct memo *key)
+{
+  const struct memo *m;
+
+  if (memo_table.ht_vec == NULL)
+    hash_init (&memo_table, 256, memo_hash_1, memo_hash_2, memo_hash_cmp);
+
+  m = hash_find_item (&memo_table, key);
+  if (m == NULL)
+    {
+      ++memo_misses;
+      return 0;
+    }
+
+  ++memo_hits;
+  *op = variable_buffer_output (*op, m->result, m->reslen);
+  return 1;
+}
+
+/* Remember that the call described by KEY produced the RESLEN chars of
+   RESULT.  */
+
+static void
+memo_add (const struct memo *key, const char *result, size_t reslen)
+{
+  size_t size = sizeof (struct memo) + key->keylen + reslen;
+  struct memo *m;
+  char *p;
+
+  if (size > MEMO_MAX_SIZE / 16)
+    return;
+
+  if (memo_table.ht_fill >= MEMO_MAX_ENTRIES
+      || memo_size + size > MEMO_MAX_SIZE)
+    {
+      hash_free_items (&memo_table);
+      memo_size = 0;
+      ++memo_flushes;
+    }
+
+  m = xmalloc (size);
+  *m = *key;
+  p = (char *) (m + 1);
+  m->key = p;
+  memcpy (p, key->key, key->keylen);
+  p += key->keylen;
+  m->result = p;
+  memcpy (p, result, reslen);
+  m->reslen = reslen;
+
+  hash_insert (&memo_table, m);
+  memo_size += size;
+}
+
+/* The names of the prerequisites of .PURE, and the value of pure_changenum
+   when they were found.  */
+
+static struct hash_table pure_names;
+static unsigned long pure_names_changenum = 0;
+
+static unsigned long
+pure_name_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 ((const char *) key);
+}
+
+static unsigned long
+pure_name_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 ((const char *) key);
+}
+
+static int
+pure_name_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE ((const char *) x, (const char *) y);
+}
+
+/* Return nonzero if the user-defined function NAME is a prerequisite of
+   .PURE.  */
+
+static int
+pure_user_function (const char *name)
+{
+  if (pure_names_changenum != pure_changenum)
+    {
+      struct file *f = lookup_file (".PURE");
+      struct dep *d;
+
+      if (pure_names.ht_vec == NULL)
+        hash_init (&pure_names, 16, pure_name_hash_1, pure_name_hash_2,
+                   pure_name_hash_cmp);
+      else
+        hash_delete_items (&pure_names);
+
+      if (f != NULL)
+        for (d = f->deps; d != NULL; d = d->next)
+          hash_insert (&pure_names, dep_name (d));
+
+      pure_names_changenum = pure_changenum;
+    }
+
+  return pure_names.ht_fill != 0 && hash_find_item (&pure_names, name) != NULL;
+}
+
+void
+memo_print_stats (const char *prefix)
+{
+  printf (_("\n%s function cache: entries = %lu / storage = %lu B / hits = %lu / misses = %lu / flushes = %lu\n"),
+          prefix, memo_table.ht_fill, (unsigned long) memo_size,
+          memo_hits, memo_misses, memo_flushes);
+}
+
+
 /* These must come after the definition of function_table.  */
 
-static char *
+char *
 expand_builtin_function (char *o, unsigned int argc, char **argv,
-                         const struct function_table_entry *entry_p)
+                         const struct function_table_entry *entry_p,
+                         struct variable *list)
 {
   char *p;
 
@@ -2466,6 +3198,30 @@ expand_builtin_function (char *o, unsigned int argc, char **argv,
   if (entry_p->adds_command)
     ++command_count;
 
+  if (entry_p->pure)
+    {
+      struct memo key;
+      size_t off = o - variable_buffer;
+
+      memo_key (&key, entry_p, NULL, argc, argv);
+      if (!memo_find (&o, &key))
+        {
+          o = entry_p->fptr.func_ptr (o, argv, entry_p->name);
+          memo_add (&key, variable_buffer + off, o - variable_buffer - off);
+        }
+      free ((char *) key.key);
+      return o;
+    }
+
+  if (list)
+    {
+      /* The last argument is LIST's value: use its word index.  */
+      list_words = variable_words (list);
+      o = entry_p->fptr.func_ptr (o, argv, entry_p->name);
+      list_words = NULL;
+      return o;
+    }
+
   if (!entry_p->alloc_fn)
     return entry_p->fptr.func_ptr (o, argv, entry_p->name);
 
@@ -2482,31 +3238,32 @@ expand_builtin_function (char *o, unsigned int argc, char **argv,
   return o;
 }
 
-/* Check for a function invocation in *STRINGP.  *STRINGP points at the
-   opening ( or { and is not null-terminated.  If a function invocation
-   is found, expand it into the buffer at *OP, updating *OP, incrementing
-   *STRINGP past the reference, and return nonzero.
-   If no function is found, return zero and don't change *OP or *STRINGP.  */
+/* Check for a function invocation at S, which points at the opening ( or {
+   and is not null-terminated.  If a function invocation is found, return its
+   function table entry, set *ARGSP to the beginning of its arguments, and set
+   *ENDP to the matching close paren or brace, or to NULL if the invocation is
+   unterminated.  *NARGSP is set to an estimate of the number of arguments:
+   the count might be high, but it'll never be low.
+   If no function is found, return NULL.  */
 
-int
-handle_function (char **op, const char **stringp)
+const struct function_table_entry *
+find_function_call (const char *s, const char **argsp, const char **endp,
+                    unsigned int *nargsp)
 {
   const struct function_table_entry *entry_p;
-  char openparen = (*stringp)[0];
+  char openparen = s[0];
   char closeparen = openparen == '(' ? ')' : '}';
   const char *beg;
   const char *end;
-  int count = 0;
-  char *abeg = NULL;
-  char **argv, **argvp;
   unsigned int nargs;
+  int count = 0;
 
-  beg = *stringp + 1;
+  beg = s + 1;
 
   entry_p = lookup_function (beg);
 
   if (!entry_p)
-    return 0;
+    return NULL;
 
   /* We found a builtin function.  Find the beginning of its arguments (skip
      whitespace after the name).  */
@@ -2516,8 +3273,7 @@ handle_function (char **op, const char **stringp)
 
   /* Find the end of the function invocation, counting nested use of whichever
      kind of parens we use.  Don't use skip_reference so we can count commas
-     to get a rough estimate of how many arguments we might have.  The count
-     might be high, but it'll never be low.  */
+     to get a rough estimate of how many arguments we might have.  */
 
   for (nargs=1, end=beg; *end != '\0'; ++end)
     if (!STOP_SET (*end, MAP_VARSEP|MAP_COMMA))
@@ -2529,10 +3285,80 @@ handle_function (char **op, const char **stringp)
     else if (*end == closeparen && --count < 0)
       break;
 
-  if (count >= 0)
+  *argsp = beg;
+  *endp = count >= 0 ? NULL : end;
+  *nargsp = nargs;
+
+  return entry_p;
+}
+
+/* Return the end of argument number ARGN to a call of ENTRY_P, where the
+   argument begins at P and the invocation ends at END: either the comma that
+   follows it, or END if it is the last argument.  */
+
+const char *
+function_argument_end (const struct function_table_entry *entry_p,
+                       unsigned int argn, char openparen,
+                       const char *p, const char *end)
+{
+  char closeparen = openparen == '(' ? ')' : '}';
+  const char *next;
+
+  if (argn == entry_p->maximum_args
+      || ((next = find_next_argument (openparen, closeparen, p, end)) == NULL))
+    next = end;
+
+  return next;
+}
+
+/* Return nonzero if ENTRY_P wants its arguments expanded before it's called.  */
+
+int
+function_expands_args (const struct function_table_entry *entry_p)
+{
+  return entry_p->expand_args;
+}
+
+/* Return nonzero if the last argument of ENTRY_P is a list of words, which
+   can be given to expand_builtin_function() as the value of a variable.  */
+
+int
+function_takes_word_list (const struct function_table_entry *entry_p)
+{
+  char *(*f) (char *, char **, const char *) = entry_p->fptr.func_ptr;
+
+  return !entry_p->alloc_fn
+    && (f == func_word || f == func_wordlist || f == func_words
+        || f == func_firstword || f == func_lastword);
+}
+
+/* Check for a function invocation in *STRINGP.  *STRINGP points at the
+   opening ( or { and is not null-terminated.  If a function invocation
+   is found, expand it into the buffer at *OP, updating *OP, incrementing
+   *STRINGP past the reference, and return nonzero.
+   If no function is found, return zero and don't change *OP or *STRINGP.  */
+
+int
+handle_function (char **op, const char **stringp)
+{
+  const struct function_table_entry *entry_p;
+  char openparen = (*stringp)[0];
+  const char *beg;
+  const char *end;
+  char *abeg = NULL;
+  char **argv, **argvp;
+  unsigned int nargs;
+  struct variable *list = NULL;
+
+  entry_p = find_function_call (*stringp, &beg, &end, &nargs);
+
+  if (!entry_p)
+    return 0;
+
+  if (end == NULL)
     fatal (*expanding_var, strlen (entry_p->name),
            _("unterminated call to function '%s': missing '%c'"),
-           entry_p->name, closeparen);
+           entry_p->name, openparen == '(' ? ')' : '}');
 
   *stringp = end;
 
@@ -2555,12 +3381,14 @@ handle_function (char **op, const char **stringp)
           const char *next;
 
           ++nargs;
+          next = function_argument_end (entry_p, nargs, openparen, p, end);
 
-          if (nargs == entry_p->maximum_args
-              || ((next = find_next_argument (openparen, closeparen, p, end)) == NULL))
-            next = end;
-
-          *argvp = expand_argument (p, next);
+          /* Pass a list of words in a simple variable without copying it.  */
+          if (next == end && function_takes_word_list (entry_p)
+              && (list = simple_variable_reference (p, next - p)) != NULL)
+            *argvp = list->value;
+          else
+            *argvp = expand_argument (p, next);
           p = next + 1;
         }
     }
@@ -2578,10 +3406,8 @@ handle_function (char **op, const char **stringp)
           char *next;
 
           ++nargs;
-
-          if (nargs == entry_p->maximum_args
-              || ((next = find_next_argument (openparen, closeparen, p, aend)) == NULL))
-            next = aend;
+          next = (char *) function_argument_end (entry_p, nargs, openparen,
+                                                 p, aend);
 
           *argvp = p;
           *next = '\0';
@@ -2591,31 +3417,35 @@ handle_function (char **op, const char **stringp)
   *argvp = NULL;
 
   /* Finally!  Run the function...  */
-  *op = expand_builtin_function (*op, nargs, argv, entry_p);
+  *op = expand_builtin_function (*op, nargs, argv, entry_p, list);
 
   /* Free memory.  */
   if (entry_p->expand_args)
-    for (argvp=argv; *argvp != 0; ++argvp)
-      free (*argvp);
+    {
+      for (argvp=argv; *argvp != 0; ++argvp)
+        if (list == NULL || *argvp != list->value)
+          free (*argvp);
+    }
   else
     free (abeg);
 
   return 1;
 }
-
+
 
 /* User-defined functions.  Expand the first argument as either a builtin
    function or a make variable, in the context of the rest of the arguments
    assigned to $1, $2, ... $N.  $0 is the name of the function.  */
 
+static char *call_user_function (char *o, char **argv, struct variable *v,
+                                 const char *fname, size_t flen);
+
 static char *
 func_call (char *o, char **argv, const char *funcname UNUSED)
 {
-  static unsigned int max_args = 0;
   char *fname;
   size_t flen;
   unsigned int i;
-  int saved_args;
   const struct function_table_entry *entry_p;
   struct variable *v;
 
@@ -2635,7 +3465,7 @@ func_call (char *o, char **argv, const char *funcname UNUSED)
       /* How many arguments do we have?  */
       for (i=0; argv[i+1]; ++i)
         ;
-      return expand_builtin_function (o, i, argv+1, entry_p);
+      return expand_builtin_function (o, i, argv+1, entry_p, NULL);
     }
 
   /* Not a builtin, so the first argument is the name of a variable to be
@@ -2650,6 +3480,39 @@ func_call (char *o, char **argv, const char *funcname UNUSED)
   if (v == 0 || *v->value == '\0')
     return o;
 
+  /* If the function was declared pure, and it's been called with these
+     arguments before, reuse the result.  */
+  if (pure_user_function (fname))
+    {
+      struct memo key;
+      size_t off = o - variable_buffer;
+
+      for (i = 0; argv[i]; ++i)
+        ;
+      memo_key (&key, &call_flavors[v->recursive], v->value, i, argv);
+      if (!memo_find (&o, &key))
+        {
+          o = call_user_function (o, argv, v, fname, flen);
+          memo_add (&key, variable_buffer + off, o - variable_buffer - off);
+        }
+      free ((char *) key.key);
+      return o;
+    }
+
+  return call_user_function (o, argv, v, fname, flen);
+}
+
+/* Expand the user-defined function V, named FNAME which is FLEN chars long,
+   with the arguments in ARGV, adding the result to the buffer at O.  */
+
+static char *
+call_user_function (char *o, char **argv, struct variable *v,
+                    const char *fname, size_t flen)
+{
+  static unsigned int max_args = 0;
+  unsigned int i;
+  int saved_args;
+
   /* Set up arguments $(1) .. $(N).  $(0) is the function name.  */
 
   push_new_variable_scope ();
@@ -2722,6 +3585,7 @@ define_new_function (const floc *flocp, const char *name,
   ent->minimum_args = (unsigned char) min;
   ent->maximum_args = (unsigned char) max;
   ent->expand_args = ANY_SET(flags, GMK_FUNC_NOEXPAND) ? 0 : 1;
+  ent->pure = 0;
   ent->alloc_fn = 1;
   /* We don't know what this function will do.  */
   ent->adds_command = 1;
@@ -2729,6 +3593,7 @@ define_new_function (const floc *flocp, const char *name,
 
   ent = hash_insert (&function_table, ent);
   free (ent);
+  ++function_changenum;
 }
 
 void
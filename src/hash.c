@@ -23,6 +23,10 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #define REALLOC(o, t, n) ((t *) xrealloc ((o), sizeof (t) * (n)))
 #define CLONE(o, t, n) ((t *) memcpy (MALLOC (t, (n)), (o), sizeof (t) * (n)))
 
+#if defined __SSE2__
+# include <emmintrin.h>
+#endif
+
 static void hash_rehash __P((struct hash_table* ht));
 static unsigned long round_up_2 __P((unsigned long rough));
 
@@ -31,10 +35,123 @@ static unsigned long round_up_2 __P((unsigned long rough));
    is forced to return an odd-value, in order to be relatively prime
    to the table size.  This guarantees that the increment can
    potentially hit every slot in the table during collision
-   resolution.  */
+   resolution.
+
+   Each slot also has a control byte: a 7-bit fingerprint of the hash of
+   its item, or a mark saying the slot is empty or deleted.  A slot whose
+   fingerprint differs from the key's can't match it, so the comparison
+   function is only called for slots that almost certainly do.  Most keys
+   are strings whose secondary hash is 1, so collisions are resolved by
+   linear probing: then the control bytes of HASH_GROUP slots are checked
+   at once.  The first HASH_GROUP - 1 control bytes are repeated after the
+   last one so that a group never has to wrap around.  The primary hash of
+   each item is kept too, so growing the table doesn't have to compute it
+   again, and the comparison function isn't called for an item whose hash
+   differs from the key's even though its fingerprint is the same.
+
+   Items end up in exactly the slots they would without the control bytes,
+   so the order in which the table is walked is unchanged.  */
+
+#define HASH_GROUP      16
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xfe
+
+/* The value of ht_last_lookup when ht_last_hash is not known.  */
+#define NO_LOOKUP       ((unsigned long) -1)
 
 const void *hash_deleted_item = &hash_deleted_item;
 
+/* Return the fingerprint of the primary hash HASH.  Its bits are mixed
+   first, since the low bits already decide the slot and some hash
+   functions don't do much with the high ones.  */
+
+static unsigned char
+fingerprint (unsigned int hash)
+{
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35U;
+  hash ^= hash >> 16;
+  return (unsigned char) (hash >> 25);
+}
+
+/* Return a mask with bit I set if the control byte of slot I of the group
+   at CTRL is FP.  Return the slots that are vacant, and those that are
+   empty, in *VACANT and *EMPTY.  */
+
+static unsigned int
+group_match (const unsigned char *ctrl, unsigned char fp,
+             unsigned int *vacant, unsigned int *empty)
+{
+#if defined __SSE2__
+  __m128i group = _mm_loadu_si128 ((const __m128i *) ctrl);
+
+  *vacant = (unsigned int) _mm_movemask_epi8 (group);
+  *empty = (unsigned int) _mm_movemask_epi8 (
+    _mm_cmpeq_epi8 (group, _mm_set1_epi8 ((char) CTRL_EMPTY)));
+  return (unsigned int) _mm_movemask_epi8 (
+    _mm_cmpeq_epi8 (group, _mm_set1_epi8 ((char) fp)));
+#else
+  unsigned int match = 0;
+  int i;
+
+  *vacant = *empty = 0;
+  for (i = 0; i < HASH_GROUP; ++i)
+    {
+      if (ctrl[i] == fp)
+        match |= 1U << i;
+      else if (ctrl[i] & 0x80)
+        {
+          *vacant |= 1U << i;
+          if (ctrl[i] == CTRL_EMPTY)
+            *empty |= 1U << i;
+        }
+    }
+  return match;
+#endif
+}
+
+/* Return the index of the lowest bit set in MASK, which isn't 0.  */
+
+static int
+first_bit (unsigned int mask)
+{
+#if defined __GNUC__
+  return __builtin_ctz (mask);
+#else
+  int i = 0;
+  while ((mask & 1) == 0)
+    {
+      mask >>= 1;
+      ++i;
+    }
+  return i;
+#endif
+}
+
+/* Set the control byte of slot I of HT to CTRL, and its copies.  */
+
+static void
+set_ctrl (struct hash_table *ht, unsigned long i, unsigned char ctrl)
+{
+  ht->ht_ctrl[i] = ctrl;
+  for (i += ht->ht_size; i < ht->ht_size + HASH_GROUP - 1; i += ht->ht_size)
+    ht->ht_ctrl[i] = ctrl;
+}
+
+/* Allocate the slots and control bytes of HT for its size.  */
+
+static void
+hash_alloc (struct hash_table *ht)
+{
+  ht->ht_vec = CALLOC (void *, ht->ht_size);
+  ht->ht_ctrl = MALLOC (unsigned char, ht->ht_size + HASH_GROUP - 1);
+  ht->ht_hashes = MALLOC (unsigned int, ht->ht_size);
+  memset (ht->ht_ctrl, CTRL_EMPTY, ht->ht_size + HASH_GROUP - 1);
+  ht->ht_empty_slots = ht->ht_size;
+}
+
 /* Force the table size to be a power of two, possibly rounding up the
    given size.  */
 
@@ -43,19 +160,12 @@ hash_init (struct hash_table *ht, unsigned long size,
            hash_func_t hash_1, hash_func_t hash_2, hash_cmp_func_t hash_cmp)
 {
   ht->ht_size = round_up_2 (size);
-  ht->ht_empty_slots = ht->ht_size;
-  ht->ht_vec = CALLOC (void *, ht->ht_size);
-  if (ht->ht_vec == 0)
-    {
-      fprintf (stderr, _("can't allocate %lu bytes for hash table: memory exhausted"),
-               ht->ht_size * (unsigned long) sizeof (void *));
-      exit (MAKE_TROUBLE);
-    }
-
+  hash_alloc (ht);
   ht->ht_capacity = ht->ht_size - (ht->ht_size / 16); /* 93.75% loading factor */
   ht->ht_fill = 0;
   ht->ht_collisions = 0;
   ht->ht_lookups = 0;
+  ht->ht_last_lookup = NO_LOOKUP;
   ht->ht_rehashes = 0;
   ht->ht_hash_1 = hash_1;
   ht->ht_hash_2 = hash_2;
@@ -83,30 +193,85 @@ hash_load (struct hash_table *ht, const void *item_table,
 
 void **
 hash_find_slot (struct hash_table *ht, const void *key)
+{
+  return hash_find_slot_hash (ht, key, (*ht->ht_hash_1) (key));
+}
+
+/* Like hash_find_slot, for a caller that already knows the primary hash
+   of 'key' (for example because it knows the length of a string key).
+   HASH must be the value ht_hash_1 would return for 'key'.  */
+
+void **
+hash_find_slot_hash (struct hash_table *ht, const void *key,
+                     unsigned long hash)
 {
   void **slot;
   void **deleted_slot = 0;
   unsigned int hash_2 = 0;
-  unsigned int hash_1 = (*ht->ht_hash_1) (key);
+  unsigned int hash_1 = (unsigned int) hash;
+  unsigned int full_hash = hash_1;
+  unsigned char fp = fingerprint (hash_1);
 
   ht->ht_lookups++;
+  ht->ht_last_lookup = ht->ht_lookups;
+  ht->ht_last_hash = full_hash;
   for (;;)
     {
       hash_1 &= (ht->ht_size - 1);
+
+      if (hash_2 == 1)
+        {
+          /* Check the group of slots from here.  Go through those that are
+             vacant or might match in order, just as one at a time.  */
+          unsigned int vacant;
+          unsigned int empty;
+          unsigned int match = group_match (&ht->ht_ctrl[hash_1], fp,
+                                            &vacant, &empty);
+          unsigned int bits = match | vacant;
+
+          while (bits)
+            {
+              int i = first_bit (bits);
+              unsigned long j = (hash_1 + i) & (ht->ht_size - 1);
+              bits &= bits - 1;
+              slot = &ht->ht_vec[j];
+
+              if (empty & (1U << i))
+                return (deleted_slot ? deleted_slot : slot);
+              if (vacant & (1U << i))
+                {
+                  if (deleted_slot == 0)
+                    deleted_slot = slot;
+                }
+              else
+                {
+                  if (key == *slot)
+                    return slot;
+                  if (ht->ht_hashes[j] == full_hash
+                      && (*ht->ht_compare) (key, *slot) == 0)
+                    return slot;
+                  ht->ht_collisions++;
+                }
+            }
+          hash_1 += HASH_GROUP;
+          continue;
+        }
+
       slot = &ht->ht_vec[hash_1];
 
-      if (*slot == 0)
+      if (ht->ht_ctrl[hash_1] == CTRL_EMPTY)
         return (deleted_slot ? deleted_slot : slot);
-      if (*slot == hash_deleted_item)
+      if (ht->ht_ctrl[hash_1] == CTRL_DELETED)
         {
           if (deleted_slot == 0)
             deleted_slot = slot;
         }
-      else
+      else if (ht->ht_ctrl[hash_1] == fp)
         {
           if (key == *slot)
             return slot;
-          if ((*ht->ht_compare) (key, *slot) == 0)
+          if (ht->ht_hashes[hash_1] == full_hash
+              && (*ht->ht_compare) (key, *slot) == 0)
             return slot;
           ht->ht_collisions++;
         }
@@ -138,6 +303,15 @@ hash_insert_at (struct hash_table *ht, const void *item, const void *slot)
   const void *old_item = *(void **) slot;
   if (HASH_VACANT (old_item))
     {
+      unsigned long i = (void **) slot - ht->ht_vec;
+      /* SLOT normally comes from the last query, which was for ITEM: if so
+         we already know its hash.  */
+      unsigned int hash = (ht->ht_last_lookup == ht->ht_lookups
+                           ? ht->ht_last_hash
+                           : (unsigned int) (*ht->ht_hash_1) (item));
+      set_ctrl (ht, i, fingerprint (hash));
+      ht->ht_hashes[i] = hash;
+      ht->ht_last_lookup = NO_LOOKUP;
       ht->ht_fill++;
       if (old_item == 0)
         ht->ht_empty_slots--;
@@ -166,6 +340,7 @@ hash_delete_at (struct hash_table *ht, const void *slot)
   void *item = *(void **) slot;
   if (!HASH_VACANT (item))
     {
+      set_ctrl (ht, (void **) slot - ht->ht_vec, CTRL_DELETED);
       *(void const **) slot = hash_deleted_item;
       ht->ht_fill--;
       return item;
@@ -186,6 +361,7 @@ hash_free_items (struct hash_table *ht)
         free (item);
       *vec = 0;
     }
+  memset (ht->ht_ctrl, CTRL_EMPTY, ht->ht_size + HASH_GROUP - 1);
   ht->ht_fill = 0;
   ht->ht_empty_slots = ht->ht_size;
 }
@@ -197,9 +373,11 @@ hash_delete_items (struct hash_table *ht)
   void **end = &vec[ht->ht_size];
   for (; vec < end; vec++)
     *vec = 0;
+  memset (ht->ht_ctrl, CTRL_EMPTY, ht->ht_size + HASH_GROUP - 1);
   ht->ht_fill = 0;
   ht->ht_collisions = 0;
   ht->ht_lookups = 0;
+  ht->ht_last_lookup = NO_LOOKUP;
   ht->ht_rehashes = 0;
   ht->ht_empty_slots = ht->ht_size;
 }
@@ -215,7 +393,11 @@ hash_free (struct hash_table *ht, int free_items)
       ht->ht_empty_slots = ht->ht_size;
     }
   free (ht->ht_vec);
+  free (ht->ht_ctrl);
+  free (ht->ht_hashes);
   ht->ht_vec = 0;
+  ht->ht_ctrl = 0;
+  ht->ht_hashes = 0;
   ht->ht_capacity = 0;
 }
 
@@ -245,14 +427,19 @@ hash_map_arg (struct hash_table *ht, hash_map_arg_func_t map, void *arg)
     }
 }
 
-/* Double the size of the hash table in the event of overflow... */
+/* Double the size of the hash table in the event of overflow...
+   The items are placed using their saved hashes, as hash_find_slot() would
+   place them, but without calling the primary hash or comparison
+   functions.  */
 
 static void
 hash_rehash (struct hash_table *ht)
 {
   unsigned long old_ht_size = ht->ht_size;
   void **old_vec = ht->ht_vec;
-  void **ovp;
+  unsigned char *old_ctrl = ht->ht_ctrl;
+  unsigned int *old_hashes = ht->ht_hashes;
+  unsigned long i;
 
   if (ht->ht_fill >= ht->ht_capacity)
     {
@@ -260,18 +447,34 @@ hash_rehash (struct hash_table *ht)
       ht->ht_capacity = ht->ht_size - (ht->ht_size >> 4);
     }
   ht->ht_rehashes++;
-  ht->ht_vec = CALLOC (void *, ht->ht_size);
+  hash_alloc (ht);
+
+  for (i = 0; i < old_ht_size; i++)
+    if (! HASH_VACANT (old_vec[i]))
+      {
+        unsigned int hash_1 = old_hashes[i];
+        unsigned int hash_2 = 0;
+
+        for (;;)
+          {
+            hash_1 &= (ht->ht_size - 1);
+            if (ht->ht_ctrl[hash_1] == CTRL_EMPTY)
+              break;
+            if (!hash_2)
+              hash_2 = (*ht->ht_hash_2) (old_vec[i]) | 1;
+            hash_1 += hash_2;
+          }
+
+        ht->ht_vec[hash_1] = old_vec[i];
+        set_ctrl (ht, hash_1, old_ctrl[i]);
+        ht->ht_hashes[hash_1] = old_hashes[i];
+      }
 
-  for (ovp = old_vec; ovp < &old_vec[old_ht_size]; ovp++)
-    {
-      if (! HASH_VACANT (*ovp))
-        {
-          void **slot = hash_find_slot (ht, *ovp);
-          *slot = *ovp;
-        }
-    }
   ht->ht_empty_slots = ht->ht_size - ht->ht_fill;
+  ht->ht_last_lookup = NO_LOOKUP;
   free (old_vec);
+  free (old_ctrl);
+  free (old_hashes);
 }
 
 void
@@ -499,3 +702,98 @@ jhash_string(unsigned const char *k)
   jhash_final(a, b, c);
   return c + (unsigned) (k - start);
 }
+
+/* hash_bytes -- hash the N bytes at K, in the style of wyhash.  Each step
+   multiplies two 64-bit words into a 128-bit product and folds its halves
+   together, so a key of up to 16 bytes costs only two multiplies.  Keys
+   of any length are read with a few (possibly overlapping) unaligned
+   loads, never a byte at a time.  */
+
+#define HASH_SECRET_0   0xa0761d6478bd642fULL
+#define HASH_SECRET_1   0xe7037ed1a0b428dbULL
+#define HASH_SECRET_2   0x8ebc6af09c88c6e3ULL
+
+static uint64_t
+hash_mum (uint64_t a, uint64_t b)
+{
+#if defined __SIZEOF_INT128__
+  unsigned __int128 r = (unsigned __int128) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+#else
+  uint64_t ha = a >> 32, la = (uint32_t) a;
+  uint64_t hb = b >> 32, lb = (uint32_t) b;
+  uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+  uint64_t t = ll + (hl << 32);
+  uint64_t lo = t + (lh << 32);
+  uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (t < ll) + (lo < t);
+  return lo ^ hi;
+#endif
+}
+
+static uint64_t
+hash_read_64 (const unsigned char *p)
+{
+  uint64_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static uint64_t
+hash_read_32 (const unsigned char *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+unsigned int
+hash_bytes (const void *key, size_t n)
+{
+  const unsigned char *k = key;
+  uint64_t seed = HASH_SECRET_0 ^ n;
+  uint64_t a, b;
+
+  if (n <= 16)
+    {
+      if (n >= 4)
+        {
+          /* Two pairs of 4-byte words cover every byte.  */
+          size_t off = (n >> 3) << 2;
+          a = (hash_read_32 (k) << 32) | hash_read_32 (k + off);
+          b = (hash_read_32 (k + n - 4) << 32) | hash_read_32 (k + n - 4 - off);
+        }
+      else if (n > 0)
+        {
+          a = ((uint64_t) k[0] << 16) | ((uint64_t) k[n >> 1] << 8) | k[n - 1];
+          b = 0;
+        }
+      else
+        a = b = 0;
+    }
+  else
+    {
+      size_t i = n;
+      while (i > 16)
+        {
+          seed = hash_mum (hash_read_64 (k) ^ HASH_SECRET_1,
+                           hash_read_64 (k + 8) ^ seed);
+          k += 16;
+          i -= 16;
+        }
+      /* The last 16 bytes of the key, which may overlap the block before.  */
+      a = hash_read_64 (k + i - 16);
+      b = hash_read_64 (k + i - 8);
+    }
+
+  a = hash_mum (a ^ HASH_SECRET_1, b ^ seed);
+  a = hash_mum (a ^ HASH_SECRET_2, n ^ HASH_SECRET_1);
+  return (unsigned int) (a ^ (a >> 32));
+}
+
+/* hash_string -- hash_bytes for a nul-terminated string.  */
+
+unsigned int
+hash_string (const char *key)
+{
+  return hash_bytes (key, strlen (key));
+}
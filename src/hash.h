@@ -41,8 +41,10 @@ typedef void (*hash_map_arg_func_t) __P((void const *item, void *arg));
 struct hash_table
 {
   void **ht_vec;
+  unsigned char *ht_ctrl;	/* fingerprint of each slot, or its state */
+  unsigned int *ht_hashes;	/* full hash of the item in each slot */
   hash_func_t ht_hash_1;	/* primary hash function */
-  hash_func_t ht_hash_2;	/* secondary hash function */
+  hash_func_t ht_hash_2;	/* secondary hash function: the probe step */
   hash_cmp_func_t ht_compare;	/* comparison function */
   unsigned long ht_size;	/* total number of slots (power of 2) */
   unsigned long ht_capacity;	/* usable slots, limited by loading-factor */
@@ -50,6 +52,8 @@ struct hash_table
   unsigned long ht_empty_slots;	/* empty slots not including deleted slots */
   unsigned long ht_collisions;	/* # of failed calls to comparison function */
   unsigned long ht_lookups;	/* # of queries */
+  unsigned long ht_last_lookup;	/* value of ht_lookups for ht_last_hash */
+  unsigned int ht_last_hash;	/* hash of the key of the last query */
   unsigned int ht_rehashes;	/* # of times we've expanded table */
 };
 
@@ -60,6 +64,8 @@ void hash_init __P((struct hash_table *ht, unsigned long size,
 void hash_load __P((struct hash_table *ht, const void *item_table,
                     unsigned long cardinality, unsigned long size));
 void **hash_find_slot __P((struct hash_table *ht, void const *key));
+void **hash_find_slot_hash __P((struct hash_table *ht, void const *key,
+                               unsigned long hash));
 void *hash_find_item __P((struct hash_table *ht, void const *key));
 void *hash_insert __P((struct hash_table *ht, const void *item));
 void *hash_insert_at __P((struct hash_table *ht, const void *item, void const *slot));
@@ -75,6 +81,8 @@ void **hash_dump __P((struct hash_table *ht, void **vector_0, qsort_cmp_t compar
 
 extern unsigned jhash(unsigned char const *key, int n);
 extern unsigned jhash_string(unsigned char const *key);
+extern unsigned int hash_bytes(const void *key, size_t n);
+extern unsigned int hash_string(const char *key);
 
 extern const void *hash_deleted_item;
 #define HASH_VACANT(item) ((item) == 0 || (void *) (item) == hash_deleted_item)
@@ -87,7 +95,7 @@ extern const void *hash_deleted_item;
 
 #define STRING_HASH_1(KEY, RESULT) do { \
   unsigned char const *_key_ = (unsigned char const *) (KEY); \
-  (RESULT) += jhash_string(_key_); \
+  (RESULT) += hash_string((const char *) _key_); \
 } while (0)
 #define return_STRING_HASH_1(KEY) do { \
   unsigned long _result_ = 0; \
@@ -95,7 +103,7 @@ extern const void *hash_deleted_item;
   return _result_; \
 } while (0)
 
-/* No need for a second hash because jhash already provides
+/* No need for a second hash because hash_bytes already provides
    pretty good results.  However, do evaluate the arguments
    to avoid warnings.  */
 #define STRING_HASH_2(KEY, RESULT) do { \
@@ -117,7 +125,7 @@ extern const void *hash_deleted_item;
 
 #define STRING_N_HASH_1(KEY, N, RESULT) do { \
   unsigned char const *_key_ = (unsigned char const *) (KEY); \
-  (RESULT) += jhash(_key_, N); \
+  (RESULT) += hash_bytes(_key_, N); \
 } while (0)
 
 #define return_STRING_N_HASH_1(KEY, N) do { \
@@ -126,7 +134,7 @@ extern const void *hash_deleted_item;
   return _result_; \
 } while (0)
 
-/* No need for a second hash because jhash already provides
+/* No need for a second hash because hash_bytes already provides
    pretty good results.  However, do evaluate the arguments
    to avoid warnings.  */
 #define STRING_N_HASH_2(KEY, N, RESULT) do { \
@@ -173,6 +181,8 @@ extern const void *hash_deleted_item;
   return _result_; \
 } while (0)
 
+#define return_STABLE_ISTRING_HASH_1(KEY) return_ISTRING_HASH_1 (KEY)
+
 #define ISTRING_COMPARE(X, Y, RESULT) do { \
   RESULT = (X) == (Y) ? 0 : strcasecmp ((X), (Y)); \
 } while (0)
@@ -185,6 +195,12 @@ extern const void *hash_deleted_item;
 #define ISTRING_HASH_1(KEY, RESULT) STRING_HASH_1 ((KEY), (RESULT))
 #define return_ISTRING_HASH_1(KEY) return_STRING_HASH_1 (KEY)
 
+/* The order in which a table is walked depends on its hash function, and
+   for the table of files that order shows in make's output.  Tables like
+   that keep the hash they always had.  */
+#define return_STABLE_ISTRING_HASH_1(KEY) \
+  return jhash_string ((unsigned char const *) (KEY))
+
 #define ISTRING_HASH_2(KEY, RESULT) STRING_HASH_2 ((KEY), (RESULT))
 #define return_ISTRING_HASH_2(KEY) return_STRING_HASH_2 (KEY)
 
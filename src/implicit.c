@@ -1011,7 +1011,7 @@ pattern_search (struct file *file, int archive,
         dep->name = s;
       else
         {
-          dep->file = lookup_file (s);
+          dep->file = lookup_cached_file (s);
           if (dep->file == 0)
             dep->file = enter_file (s);
         }
@@ -1093,12 +1093,7 @@ void
 free_childbase (struct childbase *child)
 {
   if (child->environment != 0)
-    {
-      char **ep = child->environment;
-      while (*ep != 0)
-        free (*ep++);
-      free (child->environment);
-    }
+    free_target_environment (child->environment);
 
   free (child->cmd_name);
 }
@@ -544,7 +544,7 @@ jprint_file (const void *item, void *arg)
            "\"%s\" : {\n",
            f->name);
   jprint_string ("hname", f->hname, 0);
-  jprint_string ("vpath", f->vpath, 0);
+  jprint_string ("vpath", NULL, 0);  /* No longer recorded.  */
   jprint_deps ("deps", f->deps, 0);
   jprint_cmds ("cmds", f->cmds, 0);
 
@@ -90,6 +90,8 @@ double atof ();
 #include "commands.h"
 #include "rule.h"
 #include "debug.h"
+#include "deplog.h"
+#include "statcache.h"
 #include "getopt.h"
 #include "shuffle.h"
 #include "warning.h"
@@ -2263,6 +2265,10 @@ main (int argc, char **argv, char **envp)
 
   define_makeflags (0);
 
+  /* Add the prerequisites recorded from previous runs' .DEPFILEs.  */
+
+  deplog_load ();
+
   /* Make each 'struct goaldep' point at the 'struct file' for the file
      depended on.  Also do magic for special targets.  */
 
@@ -2895,6 +2901,10 @@ main (int argc, char **argv, char **envp)
 
   shuffle_goaldeps_recursive (goals);
 
+  /* Look at the files the goals depend on all at once.  */
+
+  prefetch_mtimes (goals);
+
   /* Update the goals.  */
 
   DB (DB_BASIC, (_("Updating goal targets....\n")));
@@ -3802,6 +3812,7 @@ print_data_base (void)
   print_file_data_base ();
   print_vpath_data_base ();
   strcache_print_stats ("#");
+  memo_print_stats ("#");
 
   file_timestamp_sprintf (buf, file_timestamp_now (&resolution));
   printf (_("\n# Finished Make data base on %s\n\n"), buf);
@@ -3904,6 +3915,9 @@ die (int status)
       /* Remove the intermediate files.  */
       remove_intermediates (0);
 
+      /* Remember what we learned about files for next time.  */
+      statcache_save ();
+
       if (print_data_base_flag)
         print_data_base ();
       else if (print_data_base_json_flag) {
@@ -586,9 +586,13 @@ void *xcalloc (size_t);
 void *xrealloc (void *, size_t);
 char *xstrdup (const char *);
 char *xstrndup (const char *, size_t);
+void *alloc_record (size_t);
+void free_record (void *);
 char *find_next_token (const char **, size_t *);
 char *next_token (const char *);
 char *end_of_token (const char *);
+char *find_stopchar (const char *, int);
+char *skip_stopchars (const char *, int);
 char *skip_reference (const char *);
 void collapse_continuations (char *);
 char *lindex (const char *, const char *, int);
@@ -659,6 +663,7 @@ void strcache_print_stats (const char *prefix);
 int strcache_iscached (const char *str);
 const char *strcache_add (const char *str);
 const char *strcache_add_len (const char *str, size_t len);
+unsigned long strcache_hash (const char *str);
 
 /* Guile support  */
 int guile_gmake_setup (const floc *flocp);
@@ -39,6 +39,12 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 # include <sys/file.h>
 #endif
 
+/* The sanitizers don't know that aligned loads can't fault.  */
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(__SANITIZE_ADDRESS__)
+# include <emmintrin.h>
+# define STOPCHAR_SSE2 1
+#endif
+
 unsigned int
 make_toui (const char *str, const char **error)
 {
@@ -358,6 +364,143 @@ xstrndup (const char *str, size_t length)
   return result;
 }
 
+/* Small fixed-size records that make creates by the million (struct
+   nameseq, dep and goaldep, and struct file) are carved out of large
+   blocks instead of being malloc'd one at a time.  Records of each size
+   (rounded up to RECORD_ALIGN) come from their own blocks, and freed
+   records go on a free list for that size.
+
+   Chains of these records are often freed through a different type than
+   they were allocated as (a chain of goaldeps by free_dep_chain, say), so
+   the size of a record can't be trusted to the caller.  Instead blocks are
+   aligned to RECORD_BLOCK: the start of the block holding a record says
+   which pool it came from.  */
+
+#define RECORD_BLOCK        (64 * 1024)
+#define RECORD_BLOCKS       16
+#define RECORD_ALIGN        16
+#define RECORD_MAX          512
+
+struct record_pool
+  {
+    void *free;                 /* Freed records of this size.  */
+    char *next;                 /* Unused space in the current block.  */
+    char *end;
+  };
+
+struct record_block
+  {
+    struct record_pool *pool;
+  };
+
+/* The records in a block start a cache line after its beginning, so a
+   record whose size is a multiple of a cache line (like struct file)
+   always starts on one.  */
+#define RECORD_HEADER       64
+
+static struct record_pool record_pools[RECORD_MAX / RECORD_ALIGN + 1];
+
+/* Aligned blocks not yet given to a pool.  */
+static char *record_blocks = NULL;
+static char *record_blocks_end = NULL;
+
+static struct record_block *
+new_record_block (struct record_pool *pool)
+{
+  struct record_block *block;
+
+  if (record_blocks == record_blocks_end)
+    {
+      /* Get RECORD_BLOCKS blocks at once, plus enough to align them.  */
+      char *mem = xmalloc ((RECORD_BLOCKS + 1) * RECORD_BLOCK);
+      record_blocks = (char *) (((uintptr_t) mem + RECORD_BLOCK - 1)
+                                & ~(uintptr_t) (RECORD_BLOCK - 1));
+      record_blocks_end = record_blocks + RECORD_BLOCKS * RECORD_BLOCK;
+    }
+
+  block = (struct record_block *) record_blocks;
+  record_blocks += RECORD_BLOCK;
+  block->pool = pool;
+  return block;
+}
+
+/* Return a zeroed record of SIZE bytes, to be freed with free_record.  */
+
+void *
+alloc_record (size_t size)
+{
+  struct record_pool *pool;
+  char *result;
+
+  size = (size + RECORD_ALIGN - 1) & ~(size_t) (RECORD_ALIGN - 1);
+  assert (size > 0 && size <= RECORD_MAX);
+  pool = &record_pools[size / RECORD_ALIGN];
+
+  if (pool->free)
+    {
+      result = pool->free;
+      pool->free = *(void **) result;
+    }
+  else
+    {
+      if ((size_t) (pool->end - pool->next) < size)
+        {
+          char *block = (char *) new_record_block (pool);
+          pool->next = block + RECORD_HEADER;
+          pool->end = block + RECORD_BLOCK;
+        }
+      result = pool->next;
+      pool->next += size;
+    }
+
+  return memset (result, '\0', size);
+}
+
+/* Return up to *N records of SIZE bytes lying one after the other,
+   setting *N to how many there are.  They are never taken from the free
+   list, since it's their being next to each other that matters, and they
+   are not cleared.  */
+
+static char *
+alloc_record_run (size_t size, unsigned int *n)
+{
+  struct record_pool *pool = &record_pools[size / RECORD_ALIGN];
+  size_t room = (pool->end - pool->next) / size;
+  char *result;
+
+  if (room < *n && room < (RECORD_BLOCK - RECORD_HEADER) / size / 2)
+    {
+      /* Start a new block rather than split the run in two here.  */
+      char *block = (char *) new_record_block (pool);
+      pool->next = block + RECORD_HEADER;
+      pool->end = block + RECORD_BLOCK;
+      room = (pool->end - pool->next) / size;
+    }
+  if (room < *n)
+    *n = (unsigned int) room;
+
+  result = pool->next;
+  pool->next += *n * size;
+  return result;
+}
+
+void
+free_record (void *ptr)
+{
+  struct record_block *block;
+
+  if (ptr == NULL)
+    return;
+
+  block = (struct record_block *) ((uintptr_t) ptr
+                                   & ~(uintptr_t) (RECORD_BLOCK - 1));
+  assert (block->pool >= record_pools
+          && block->pool < record_pools + sizeof (record_pools)
+                                          / sizeof (record_pools[0]));
+  *(void **) ptr = block->pool->free;
+  block->pool->free = ptr;
+}
+
 #ifndef HAVE_MEMRCHR
 void *
 memrchr(const void* str, int ch, size_t len)
@@ -399,14 +542,157 @@ lindex (const char *s, const char *limit, int c)
   return 0;
 }
 
+#ifdef STOPCHAR_SSE2
+
+/* Strings are scanned for stop characters 16 bytes at a time by comparing
+   each block with every character in the stop map.  The characters in each
+   map that is used are remembered here.  Maps containing more than
+   STOPSET_CHARS characters are scanned a byte at a time.
+
+   The loads are aligned, so although they may read past the end of the
+   string they never cross into a page that the string doesn't touch.  */
+
+#define STOPSET_CHARS   8
+#define STOPSET_SIZE    32
+
+struct stopset
+  {
+    __m128i chars[STOPSET_CHARS]; /* Each stop character, in every byte.  */
+    int map;                    /* The stop map, or 0 if the slot is free.  */
+    int nchars;                 /* Number of characters, or -1 if too many.  */
+  };
+
+static const struct stopset *
+get_stopset (int map)
+{
+  static struct stopset stopsets[STOPSET_SIZE];
+  unsigned int i = (unsigned int) map % STOPSET_SIZE;
+  unsigned int n;
+
+  for (n = 0; n < STOPSET_SIZE; ++n, i = (i + 1) % STOPSET_SIZE)
+    {
+      struct stopset *ss = &stopsets[i];
+      int c;
+
+      if (ss->map == map)
+        return ss;
+      if (ss->map != 0)
+        continue;
+
+      ss->map = map;
+      ss->nchars = 0;
+      for (c = 0; c <= UCHAR_MAX; ++c)
+        if (STOP_SET (c, map))
+          {
+            if (ss->nchars == STOPSET_CHARS)
+              {
+                ss->nchars = -1;
+                break;
+              }
+            ss->chars[ss->nchars++] = _mm_set1_epi8 ((char) c);
+          }
+      return ss;
+    }
+
+  return NULL;
+}
+
+/* Return a mask with a bit set for each byte of BLOCK which is in SS.  */
+
+static unsigned int
+stopset_mask (const struct stopset *ss, __m128i block)
+{
+  __m128i m = _mm_cmpeq_epi8 (block, ss->chars[0]);
+  int i;
+
+  for (i = 1; i < ss->nchars; ++i)
+    m = _mm_or_si128 (m, _mm_cmpeq_epi8 (block, ss->chars[i]));
+
+  return (unsigned int) _mm_movemask_epi8 (m);
+}
+
+#endif /* STOPCHAR_SSE2 */
+
+/* Return the address of the first character in the string S which is in
+   STOPMAP, or of its terminating null.  */
+
+char *
+find_stopchar (const char *s, int stopmap)
+{
+  stopmap |= MAP_NUL;
+
+#ifdef STOPCHAR_SSE2
+  {
+    const struct stopset *ss = get_stopset (stopmap);
+
+    if (ss != NULL && ss->nchars > 0)
+      {
+        unsigned int off = (size_t) s & 15;
+        const char *p = s - off;
+        unsigned int mask;
+
+        mask = stopset_mask (ss, _mm_load_si128 ((const __m128i *) p)) >> off;
+        if (mask)
+          return (char *) s + __builtin_ctz (mask);
+
+        while (1)
+          {
+            p += 16;
+            mask = stopset_mask (ss, _mm_load_si128 ((const __m128i *) p));
+            if (mask)
+              return (char *) p + __builtin_ctz (mask);
+          }
+      }
+  }
+#endif
+
+  while (! STOP_SET (*s, stopmap))
+    ++s;
+  return (char *) s;
+}
+
+/* Return the address of the first character in the string S which is not
+   in SKIPMAP.  SKIPMAP must not contain MAP_NUL.  */
+
+char *
+skip_stopchars (const char *s, int skipmap)
+{
+#ifdef STOPCHAR_SSE2
+  const struct stopset *ss = get_stopset (skipmap);
+
+  if (ss != NULL && ss->nchars > 0)
+    {
+      unsigned int off = (size_t) s & 15;
+      const char *p = s - off;
+      unsigned int mask;
+
+      mask = ~stopset_mask (ss, _mm_load_si128 ((const __m128i *) p)) & 0xffff;
+      mask >>= off;
+      if (mask)
+        return (char *) s + __builtin_ctz (mask);
+
+      while (1)
+        {
+          p += 16;
+          mask = ~stopset_mask (ss, _mm_load_si128 ((const __m128i *) p));
+          mask &= 0xffff;
+          if (mask)
+            return (char *) p + __builtin_ctz (mask);
+        }
+    }
+#endif
+
+  while (STOP_SET (*s, skipmap))
+    ++s;
+  return (char *) s;
+}
+
 /* Return the address of the first whitespace or null in the string S.  */
 
 char *
 end_of_token (const char *s)
 {
-  while (! END_OF_TOKEN (*s))
-    ++s;
-  return (char *)s;
+  return find_stopchar (s, MAP_SPACE);
 }
 
 /* Return the address of the first nonwhitespace or null in the string S.  */
@@ -414,8 +700,12 @@ end_of_token (const char *s)
 char *
 next_token (const char *s)
 {
-  NEXT_TOKEN (s);
-  return (char *)s;
+  /* Most tokens aren't preceded by whitespace, or only by one blank.  */
+  if (! ISSPACE (*s))
+    return (char *) s;
+  if (! ISSPACE (s[1]))
+    return (char *) s + 1;
+  return skip_stopchars (s + 2, MAP_SPACE);
 }
 
 /* This function returns P if P points to EOS, or P+1 if P is NOT an open
@@ -537,7 +827,7 @@ copy_dep (const struct dep *d)
 
   if (d)
     {
-      new = xmalloc (sizeof (struct dep));
+      new = alloc_dep ();
       memcpy (new, d, sizeof (struct dep));
 
       if (new->need_2nd_expansion)
@@ -571,6 +861,103 @@ copy_dep_chain (const struct dep *d)
   return firstnew;
 }
 
+/* Move each of the N chains of 'struct dep' pointed to by CHAINS into
+   records next to each other in memory, so walking it touches as few
+   cache lines as possible; chains that already are laid out that way are
+   left alone.  The chains must not have been shuffled yet: their 'shuf'
+   links would be left pointing at the old records.
+
+   Following a scattered chain costs a cache miss per link, so several
+   chains are followed at once: their misses then overlap instead of
+   coming one after another.  */
+
+#define COMPACT_WAYS    32
+
+void
+compact_dep_chains (struct dep **chains[], unsigned int n)
+{
+  const size_t size = (sizeof (struct dep) + RECORD_ALIGN - 1)
+                      & ~(size_t) (RECORD_ALIGN - 1);
+  unsigned int i;
+
+  for (i = 0; i < n; i += COMPACT_WAYS)
+    {
+      struct dep *old[COMPACT_WAYS];
+      struct dep **dp[COMPACT_WAYS];
+      char *run[COMPACT_WAYS];
+      unsigned int len[COMPACT_WAYS];
+      unsigned int room[COMPACT_WAYS];
+      int scattered[COMPACT_WAYS];
+      unsigned int ways = n - i < COMPACT_WAYS ? n - i : COMPACT_WAYS;
+      unsigned int k, active;
+
+      /* Find out how long each chain is and whether it is scattered.  */
+      for (k = 0; k < ways; ++k)
+        {
+          old[k] = *chains[i + k];
+          len[k] = 0;
+          scattered[k] = 0;
+        }
+      do
+        for (active = k = 0; k < ways; ++k)
+          if (old[k])
+            {
+              struct dep *next = old[k]->next;
+
+              assert (old[k]->shuf == NULL);
+              ++len[k];
+              if (next && (char *) next != (char *) old[k] + size)
+                scattered[k] = 1;
+              old[k] = next;
+              ++active;
+            }
+      while (active);
+
+      /* Make room for the scattered ones.  */
+      for (k = 0; k < ways; ++k)
+        {
+          dp[k] = chains[i + k];
+          if (scattered[k])
+            {
+              old[k] = *chains[i + k];
+              room[k] = len[k];
+              run[k] = alloc_record_run (size, &room[k]);
+            }
+        }
+
+      /* Copy them over.  */
+      do
+        for (active = k = 0; k < ways; ++k)
+          if (old[k])
+            {
+              struct dep *new;
+              struct dep *d = old[k];
+
+              if (room[k] == 0)
+                {
+                  room[k] = len[k];
+                  run[k] = alloc_record_run (size, &room[k]);
+                }
+              new = (struct dep *) run[k];
+              run[k] += size;
+              --room[k];
+              --len[k];
+
+              old[k] = d->next;
+              memcpy (new, d, sizeof (struct dep));
+              free_dep (d);
+              *dp[k] = new;
+              dp[k] = &new->next;
+              ++active;
+            }
+      while (active);
+
+      for (k = 0; k < ways; ++k)
+        if (dp[k] != chains[i + k])
+          *dp[k] = NULL;
+    }
+}
+
 /* Free a chain of struct nameseq.
    For struct dep chains use free_dep_chain.  */
 
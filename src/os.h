@@ -155,6 +155,35 @@ void osync_release (void);
 
 #endif  /* NO_OUTPUT_SYNC */
 
+/* What os_stat_files() found out about a file.  If ERR is not 0, it is the
+   errno value stat() failed with and the other fields are not set.  */
+struct os_stat
+  {
+    time_t mtime;
+    long mtime_ns;
+    uintmax_t ino;
+    uintmax_t size;
+    int err;
+  };
+
+/* Ways os_stat_files() may look at files.  */
+#define OS_STAT_THREADS 0x1
+#define OS_STAT_URING   0x2
+
+#if MK_OS_VMS || MK_OS_W32 || MK_OS_DOS
+# define os_remote_files() (0)
+# define os_stat_files(_count, _names, _results, _how) (0)
+#else
+/* Return 1 if the current directory is on a network file system.  */
+int os_remote_files (void);
+
+/* Look at the COUNT files NAMES all at once, in one of the ways in HOW,
+   storing what was found in RESULTS.  Return 1 if that was done, or 0 if
+   the files must be looked at one at a time instead.  */
+unsigned int os_stat_files (size_t count, const char *const *names,
+                            struct os_stat *results, unsigned int how);
+#endif
+
 /* Create a "bad" file descriptor for stdin when parallel jobs are run.  */
 #if MK_OS_VMS || MK_OS_W32 || MK_OS_DOS
 # define get_bad_stdin() (-1)
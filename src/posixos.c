@@ -37,6 +37,26 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 # include <sys/select.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#if defined(HAVE_SYS_STATFS_H) && defined(HAVE_LINUX_MAGIC_H)
+# include <sys/statfs.h>
+# include <linux/magic.h>
+# define USE_STATFS_MAGIC 1
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_STRUCT_STATX)
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) \
+     && defined(__NR_io_uring_register) && defined(IO_URING_OP_SUPPORTED)
+#  define USE_IO_URING 1
+# endif
+#endif
+
 #include "debug.h"
 #include "job.h"
 #include "os.h"
@@ -927,3 +947,415 @@ os_anontmp ()
 
   return fd;
 }
+
+/* Return 1 if looking at files in the current directory means asking a
+   server for them.  Only Linux tells us what kind of file system a
+   directory is on in a way we can use.  Files elsewhere, on other mounts,
+   are not checked: a build with its sources on a server but run from a
+   local directory has to ask with .PREFETCH.  */
+
+int
+os_remote_files (void)
+{
+#ifdef USE_STATFS_MAGIC
+  static const unsigned long remote[] =
+    {
+#ifdef NFS_SUPER_MAGIC
+      NFS_SUPER_MAGIC,
+#endif
+#ifdef SMB_SUPER_MAGIC
+      SMB_SUPER_MAGIC,
+#endif
+#ifdef CIFS_SUPER_MAGIC
+      CIFS_SUPER_MAGIC,
+#endif
+#ifdef SMB2_SUPER_MAGIC
+      SMB2_SUPER_MAGIC,
+#endif
+#ifdef AFS_SUPER_MAGIC
+      AFS_SUPER_MAGIC,
+#endif
+#ifdef CEPH_SUPER_MAGIC
+      CEPH_SUPER_MAGIC,
+#endif
+#ifdef V9FS_MAGIC
+      V9FS_MAGIC,
+#endif
+#ifdef FUSE_SUPER_MAGIC
+      FUSE_SUPER_MAGIC,
+#endif
+      0
+    };
+  const unsigned long *p;
+  struct statfs sf;
+  int e;
+
+  EINTRLOOP (e, statfs (".", &sf));
+  if (e != 0)
+    return 0;
+
+  for (p = remote; *p != 0; ++p)
+    if (((unsigned long) sf.f_type & 0xffffffffUL) == *p)
+      return 1;
+#endif
+
+  return 0;
+}
+
+#ifdef USE_IO_URING
+
+/* On Linux an io_uring lets us hand the kernel many statx() requests with a
+   single system call, and collect the answers the same way.  The kernel
+   always passes them on to threads of its own, which costs more than it
+   saves when the answers are in memory anyway, so the ring is only used for
+   files on network file systems.  There is no liburing to lean on, so the
+   ring is set up here; if anything about it fails, the caller falls back to
+   threads.  */
+
+#define URING_ENTRIES 256
+
+/* The kernel's threads for statx() are limited to four per CPU, too few to
+   keep a server busy.  Since Linux 5.15 the limit can be raised with
+   IORING_REGISTER_IOWQ_MAX_WORKERS, which older headers don't have.  */
+
+#define URING_WORKERS 64
+#define URING_REGISTER_IOWQ_MAX_WORKERS 19
+
+struct uring
+  {
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_size;
+    void *cq_ring;
+    size_t cq_size;
+    size_t sqes_size;
+  };
+
+static void
+uring_close (struct uring *r)
+{
+  if (r->sqes != MAP_FAILED)
+    munmap (r->sqes, r->sqes_size);
+  if (r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring)
+    munmap (r->cq_ring, r->cq_size);
+  if (r->sq_ring != MAP_FAILED)
+    munmap (r->sq_ring, r->sq_size);
+  close (r->fd);
+}
+
+/* Set up the ring R.  Return 0 if io_uring or its statx() are missing.  */
+
+static int
+uring_open (struct uring *r)
+{
+  struct io_uring_params p;
+  struct io_uring_probe *probe;
+  size_t probe_size;
+  char *sq, *cq;
+  int ok;
+
+  memset (&p, '\0', sizeof (p));
+  r->fd = (int) syscall (__NR_io_uring_setup, URING_ENTRIES, &p);
+  if (r->fd < 0)
+    return 0;
+  fd_noinherit (r->fd);
+
+  r->sq_ring = r->cq_ring = r->sqes = MAP_FAILED;
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP && r->cq_size > r->sq_size)
+    r->sq_size = r->cq_size;
+
+  r->sq_ring = mmap (NULL, r->sq_size, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_ring == MAP_FAILED)
+    goto fail;
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    r->cq_ring = r->sq_ring;
+  else
+    {
+      r->cq_ring = mmap (NULL, r->cq_size, PROT_READ|PROT_WRITE,
+                         MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+      if (r->cq_ring == MAP_FAILED)
+        goto fail;
+    }
+  r->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  r->sqes = mmap (NULL, r->sqes_size, PROT_READ|PROT_WRITE,
+                  MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED)
+    goto fail;
+
+  sq = r->sq_ring;
+  cq = r->cq_ring;
+  r->sq_head = (unsigned int *) (sq + p.sq_off.head);
+  r->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+  r->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned int *) (sq + p.sq_off.array);
+  r->cq_head = (unsigned int *) (cq + p.cq_off.head);
+  r->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+  r->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  /* Kernels before 5.6 have io_uring, but can't statx() with it.  */
+  probe_size = sizeof (struct io_uring_probe)
+    + 256 * sizeof (struct io_uring_probe_op);
+  probe = xcalloc (probe_size);
+  ok = (syscall (__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE,
+                 probe, 256) == 0
+        && probe->last_op >= IORING_OP_STATX
+        && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED));
+  free (probe);
+  if (ok)
+    {
+      /* Older kernels keep the limit as it was.  */
+      unsigned int workers[2] = { URING_WORKERS, 0 };
+      syscall (__NR_io_uring_register, r->fd,
+               URING_REGISTER_IOWQ_MAX_WORKERS, workers, 2);
+      return 1;
+    }
+
+ fail:
+  uring_close (r);
+  return 0;
+}
+
+static unsigned int
+uring_stat_files (size_t count, const char *const *names,
+                  struct os_stat *results)
+{
+  static int unusable = 0;
+  struct uring r;
+  struct statx *bufs;
+  size_t *index;
+  unsigned int *slots;
+  unsigned int nfree = URING_ENTRIES;
+  unsigned int tail;
+  size_t next = 0;
+  size_t pending = 0;
+  unsigned int i;
+
+  if (unusable || !uring_open (&r))
+    {
+      unusable = 1;
+      return 0;
+    }
+
+  /* Each request in flight has a slot, holding its statx buffer and the
+     index of its file.  */
+  bufs = xmalloc (URING_ENTRIES * sizeof (struct statx));
+  index = xmalloc (URING_ENTRIES * sizeof (size_t));
+  slots = xmalloc (URING_ENTRIES * sizeof (unsigned int));
+  for (i = 0; i < URING_ENTRIES; ++i)
+    slots[i] = i;
+
+  tail = *r.sq_tail;
+  while (next < count || pending > 0)
+    {
+      unsigned int submit = 0;
+      unsigned int wait;
+      unsigned int head;
+      long e;
+
+      while (next < count && nfree > 0)
+        {
+          unsigned int slot = slots[--nfree];
+          struct io_uring_sqe *sqe = &r.sqes[tail & *r.sq_mask];
+
+          memset (sqe, '\0', sizeof (*sqe));
+          sqe->opcode = IORING_OP_STATX;
+          sqe->fd = AT_FDCWD;
+          sqe->addr = (unsigned long) names[next];
+          sqe->len = STATX_MTIME | STATX_INO | STATX_SIZE;
+          sqe->off = (unsigned long) &bufs[slot];
+          sqe->user_data = slot;
+          r.sq_array[tail & *r.sq_mask] = tail & *r.sq_mask;
+          index[slot] = next++;
+          ++tail;
+          ++submit;
+        }
+      __atomic_store_n (r.sq_tail, tail, __ATOMIC_RELEASE);
+      pending += submit;
+
+      /* Hand over the requests not yet taken, and wait until half of the
+         slots are free again: waking up for every answer costs more than
+         the answers do when the files are in the cache.  */
+      submit = tail - __atomic_load_n (r.sq_head, __ATOMIC_ACQUIRE);
+      wait = pending > URING_ENTRIES / 2 ? pending - URING_ENTRIES / 2
+                                         : pending;
+      EINTRLOOP (e, syscall (__NR_io_uring_enter, r.fd, submit, wait,
+                             IORING_ENTER_GETEVENTS, NULL, 0));
+      if (e < 0)
+        {
+          /* The kernel may still write to the buffers: leave them be.  */
+          uring_close (&r);
+          unusable = 1;
+          return 0;
+        }
+
+      head = *r.cq_head;
+      while (head != __atomic_load_n (r.cq_tail, __ATOMIC_ACQUIRE))
+        {
+          const struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+          unsigned int slot = (unsigned int) cqe->user_data;
+          struct os_stat *res = &results[index[slot]];
+
+          if (cqe->res < 0)
+            res->err = -cqe->res;
+          else
+            {
+              const struct statx *stx = &bufs[slot];
+
+              res->err = 0;
+              res->mtime = stx->stx_mtime.tv_sec;
+              res->mtime_ns = stx->stx_mtime.tv_nsec;
+              res->ino = stx->stx_ino;
+              res->size = stx->stx_size;
+            }
+          slots[nfree++] = slot;
+          --pending;
+          ++head;
+        }
+      __atomic_store_n (r.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+  free (slots);
+  free (index);
+  free (bufs);
+  uring_close (&r);
+
+  return 1;
+}
+
+#endif /* USE_IO_URING */
+
+#ifdef HAVE_PTHREAD
+
+/* Looking at files over a network takes longer waiting for the server than
+   doing anything else, so a few threads keep a number of requests in flight.
+   Each takes names off the list in slices, to keep locking infrequent.  */
+
+#define STAT_THREADS 16
+#define STAT_SLICE   64
+
+struct stat_batch
+  {
+    pthread_mutex_t lock;
+    const char *const *names;
+    struct os_stat *results;
+    size_t count;
+    size_t next;
+  };
+
+static void *
+stat_worker (void *arg)
+{
+  struct stat_batch *batch = arg;
+
+  while (1)
+    {
+      size_t i, end;
+
+      pthread_mutex_lock (&batch->lock);
+      i = batch->next;
+      end = i + STAT_SLICE < batch->count ? i + STAT_SLICE : batch->count;
+      batch->next = end;
+      pthread_mutex_unlock (&batch->lock);
+
+      if (i == end)
+        break;
+
+      for (; i < end; ++i)
+        {
+          struct os_stat *r = &batch->results[i];
+          struct stat st;
+          int e;
+
+          EINTRLOOP (e, stat (batch->names[i], &st));
+          if (e != 0)
+            {
+              r->err = errno;
+              continue;
+            }
+          r->err = 0;
+          r->mtime = st.st_mtime;
+#if FILE_TIMESTAMP_HI_RES
+          r->mtime_ns = st.ST_MTIM_NSEC;
+#else
+          r->mtime_ns = 0;
+#endif
+          r->ino = st.st_ino;
+          r->size = st.st_size;
+        }
+    }
+
+  return NULL;
+}
+
+static unsigned int
+thread_stat_files (size_t count, const char *const *names,
+                   struct os_stat *results)
+{
+  pthread_t threads[STAT_THREADS];
+  struct stat_batch batch;
+  sigset_t all, old;
+  unsigned int n, started;
+
+  n = (unsigned int) ((count + STAT_SLICE - 1) / STAT_SLICE);
+  if (n > STAT_THREADS)
+    n = STAT_THREADS;
+
+  batch.names = names;
+  batch.results = results;
+  batch.count = count;
+  batch.next = 0;
+  if (pthread_mutex_init (&batch.lock, NULL) != 0)
+    return 0;
+
+  /* Signals are for the main thread to handle.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (started = 0; started < n; ++started)
+    if (pthread_create (&threads[started], NULL, stat_worker, &batch) != 0)
+      break;
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  /* Whatever threads we could start do all of the work; if there are none,
+     so be it.  */
+  while (started > 0)
+    pthread_join (threads[--started], NULL);
+
+  pthread_mutex_destroy (&batch.lock);
+
+  return batch.next == count;
+}
+
+#endif /* HAVE_PTHREAD */
+
+unsigned int
+os_stat_files (size_t count, const char *const *names, struct os_stat *results,
+               unsigned int how)
+{
+#ifdef USE_IO_URING
+  if (ANY_SET (how, OS_STAT_URING) && uring_stat_files (count, names, results))
+    return 1;
+#endif
+#ifdef HAVE_PTHREAD
+  if (ANY_SET (how, OS_STAT_THREADS)
+      && thread_stat_files (count, names, results))
+    return 1;
+#endif
+  (void) count;
+  (void) names;
+  (void) results;
+  (void) how;
+  return 0;
+}
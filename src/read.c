@@ -27,6 +27,11 @@ struct passwd *getpwnam (char *name);
 # include <pwd.h>
 #endif
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# include <sys/mman.h>
+# define MAP_MAKEFILES 1
+#endif
+
 #include "filedef.h"
 #include "dep.h"
 #include "job.h"
@@ -50,8 +55,16 @@ struct ebuffer
     size_t size;        /* Malloc'd size of buffer. */
     FILE *fp;           /* File, or NULL if this is an internal buffer.  */
     floc floc;          /* Info on the file in fp (if any).  */
+    const char *map;    /* The file in fp mapped into memory, or NULL.  */
+    const char *mapnext; /* Start of the next line in the map.  */
+    size_t mapsize;     /* Size of the map.  */
   };
 
+/* Makefiles at least this large are mapped into memory rather than read a
+   line at a time.  */
+
+#define MAP_MIN_SIZE (64 * 1024)
+
 /* Track the modifiers we can have on variable assignments */
 
 struct vmodifiers
@@ -131,7 +144,9 @@ static struct goaldep *read_files = 0;
 
 static struct goaldep *eval_makefile (const char *filename, unsigned short flags);
 static void eval (struct ebuffer *buffer, int flags);
+static int eval_depfile (struct ebuffer *ebuf, int set_default);
 
+static int map_makefile (struct ebuffer *ebuf);
 static long readline (struct ebuffer *ebuf);
 static void do_undefine (char *name, enum variable_origin origin,
                          struct ebuffer *ebuf);
@@ -318,6 +333,8 @@ eval_makefile (const char *filename, unsigned short flags)
         printf (_(" (don't care)"));
       if (flags & RM_NO_TILDE)
         printf (_(" (no ~ expansion)"));
+      if (flags & RM_DEPFILE)
+        printf (_(" (dependency file)"));
       puts ("...");
     }
 
@@ -381,7 +398,7 @@ eval_makefile (const char *filename, unsigned short flags)
 
   /* Enter the final name for this makefile as a goaldep.  */
   filename = strcache_add (filename);
-  deps->file = lookup_file (filename);
+  deps->file = lookup_cached_file (filename);
   if (deps->file == 0)
     deps->file = enter_file (filename);
   filename = deps->file->name;
@@ -419,16 +436,29 @@ eval_makefile (const char *filename, unsigned short flags)
 
   ebuf.size = 200;
   ebuf.buffer = ebuf.bufnext = ebuf.bufstart = xmalloc (ebuf.size);
+  ebuf.map = NULL;
 
   curfile = reading_file;
   reading_file = &ebuf.floc;
 
-  eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+  /* Dependency files written by compilers are usually nothing but simple
+     rules: try to enter them without going through eval().  */
+  if (!(flags & RM_DEPFILE)
+      || !eval_depfile (&ebuf, !(flags & RM_NO_DEFAULT_GOAL)))
+    {
+      map_makefile (&ebuf);
+      eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+    }
 
   reading_file = curfile;
 
   fclose (ebuf.fp);
 
+#ifdef MAP_MAKEFILES
+  if (ebuf.map)
+    munmap ((void *) ebuf.map, ebuf.mapsize);
+#endif
+
   free (ebuf.bufstart);
   free_alloca ();
 
@@ -436,6 +466,213 @@ eval_makefile (const char *filename, unsigned short flags)
   return deps;
 }
 
+/* Words that start a directive line.  A dependency file containing a line
+   that begins with one of these must be read by eval().  */
+
+static const char *const depfile_directives[] =
+  {
+    "define", "else", "endef", "endif", "export", "ifdef", "ifeq", "ifndef",
+    "ifneq", "include", "-include", "include-deps", "-include-deps", "load",
+    "-load", "override", "private", "sinclude", "undefine", "unexport",
+    "vpath", NULL
+  };
+
+/* Return the first colon between P and EOL, skipping DOS drive letters in
+   the words starting at TOK, or NULL if there is none.  */
+
+static const char *
+find_depfile_colon (const char *tok, const char *p, const char *eol)
+{
+  while ((p = memchr (p, ':', eol - p)) != NULL)
+    {
+#ifdef HAVE_DOS_PATHS
+      if (p + 1 < eol && ISDIRSEP (p[1]) && p > tok
+          && isalpha ((unsigned char) p[-1])
+          && (p == tok + 1 || strchr (" \t(", p[-2]) != 0))
+        {
+          ++p;
+          continue;
+        }
+#endif
+      return p;
+    }
+
+  return NULL;
+}
+
+/* Read the makefile open in EBUF, which was named by an 'include-deps'
+   directive, without using eval().
+
+   Files generated by compilers (for example with GCC's -MMD option) contain
+   only rules of the form "TARGETS: PREREQUISITES" with no recipes, variable
+   references, or assignments.  For these we can skip line collapsing,
+   conditional and directive processing, and expansion, and hand each rule
+   straight to record_files().  If the file contains anything that might be
+   treated differently by eval() the stream is rewound and 0 is returned so
+   the caller can read it in the normal way.  Returns 1 if the file was
+   completely handled here.  */
+
+static int
+eval_depfile (struct ebuffer *ebuf, int set_default)
+{
+  struct stat st;
+  char *buf;
+  char *bol;
+  char *end;
+  size_t len;
+  floc fi;
+
+  if (fstat (fileno (ebuf->fp), &st) != 0 || !S_ISREG (st.st_mode)
+      || (uintmax_t) st.st_size >= SIZE_MAX)
+    return 0;
+
+  len = (size_t) st.st_size;
+  buf = xmalloc (len + 1);
+  if (fread (buf, 1, len, ebuf->fp) != len || fgetc (ebuf->fp) != EOF)
+    goto fallback;
+  buf[len] = '\0';
+  end = buf + len;
+
+  /* Anything involving variables, recipes, comments, or special rule
+     syntax is left to eval().  Also check for NUL bytes, a UTF-8 BOM,
+     double-colon rules and quoted colons.  */
+  if (strlen (buf) != len || (unsigned char) buf[0] == 0xEF
+      || strpbrk (buf, "$#;=%&\r") != NULL
+      || strstr (buf, "::") != NULL || strstr (buf, "\\:") != NULL)
+    goto fallback;
+
+  /* Make sure that every logical line is either blank or a rule.  */
+  for (bol = buf; bol < end; )
+    {
+      char *eol = bol;
+      const char *p;
+      const char *const *kw;
+      size_t wlen;
+
+      while (1)
+        {
+          int backslash = 0;
+          const char *q;
+
+          eol = memchr (eol, '\n', end - eol);
+          if (eol == NULL)
+            {
+              eol = end;
+              break;
+            }
+          for (q = eol; q > bol && q[-1] == '\\'; --q)
+            backslash = !backslash;
+          if (!backslash)
+            break;
+          ++eol;
+        }
+
+      if (*bol == cmd_prefix)
+        goto fallback;
+
+      p = next_token (bol);
+      if (p < eol)
+        {
+          const char *colonp = find_depfile_colon (p, p, eol);
+
+          /* A line with a second colon is a static pattern rule or an
+             error, and eval() knows which.  */
+          if (colonp == NULL
+              || find_depfile_colon (p, colonp + 1, eol) != NULL)
+            goto fallback;
+
+          wlen = end_of_token (p) - p;
+          for (kw = depfile_directives; *kw != NULL; ++kw)
+            if (strlen (*kw) == wlen && strneq (p, *kw, wlen))
+              goto fallback;
+        }
+
+      bol = eol + 1;
+    }
+
+  /* It's safe to enter the rules directly.  */
+  fi.filenm = ebuf->floc.filenm;
+  fi.offset = 0;
+
+  for (bol = buf; bol < end; )
+    {
+      char *eol = bol;
+      unsigned long nlines = 1;
+      struct nameseq *filenames;
+      char *colonp;
+      char *depstr;
+      char *p;
+      const char *beg;
+      const char *last;
+
+      while (1)
+        {
+          int backslash = 0;
+          const char *q;
+
+          eol = memchr (eol, '\n', end - eol);
+          if (eol == NULL)
+            {
+              eol = end;
+              break;
+            }
+          for (q = eol; q > bol && q[-1] == '\\'; --q)
+            backslash = !backslash;
+          if (!backslash)
+            break;
+          ++eol;
+          ++nlines;
+        }
+      *eol = '\0';
+
+      fi.lineno = ebuf->floc.lineno;
+      ebuf->floc.lineno += nlines;
+
+      p = bol;
+      bol = eol + 1;
+
+      collapse_continuations (p);
+      p = next_token (p);
+      if (*p == '\0')
+        continue;
+
+      colonp = find_char_unquote (p, ':');
+#ifdef HAVE_DOS_PATHS
+      while (colonp && ISDIRSEP (colonp[1])
+             && isalpha ((unsigned char) colonp[-1])
+             && (colonp == p + 1 || strchr (" \t(", colonp[-2]) != 0))
+        colonp = find_char_unquote (colonp + 1, ':');
+#endif
+      if (colonp == NULL)
+        O (fatal, &fi, _("missing separator"));
+
+      *colonp = '\0';
+      filenames = PARSE_SIMPLE_SEQ (&p, struct nameseq);
+      if (filenames == NULL)
+        continue;
+
+      beg = colonp + 1;
+      last = beg + strlen (beg) - 1;
+      strip_whitespace (&beg, &last);
+      depstr = beg <= last && *beg != '\0'
+        ? xstrndup (beg, last - beg + 1) : NULL;
+
+      check_specials (filenames, set_default);
+      record_files (filenames, 0, NULL, NULL, depstr, fi.lineno, NULL, 0, 0,
+                    cmd_prefix, &fi);
+    }
+
+  free (buf);
+  return 1;
+
+ fallback:
+  DB (DB_VERBOSE, (_("Reading dependency file '%s' as a makefile\n"),
+                   ebuf->floc.filenm));
+  free (buf);
+  rewind (ebuf->fp);
+  return 0;
+}
+
 void
 eval_buffer (char *buffer, const floc *flocp)
 {
@@ -449,6 +686,7 @@ eval_buffer (char *buffer, const floc *flocp)
   ebuf.size = strlen (buffer);
   ebuf.buffer = ebuf.bufnext = ebuf.bufstart = buffer;
   ebuf.fp = NULL;
+  ebuf.map = NULL;
 
   if (flocp)
     ebuf.floc = *flocp;
@@ -854,8 +1092,10 @@ eval (struct ebuffer *ebuf, int set_default)
           continue;
         }
 
-      /* Handle include and variants.  */
-      if (word1eq ("include") || word1eq ("-include") || word1eq ("sinclude"))
+      /* Handle include and variants.  Allow targets named "include-deps".  */
+      if (word1eq ("include") || word1eq ("-include") || word1eq ("sinclude")
+          || ((word1eq ("include-deps") || word1eq ("-include-deps"))
+              && !is_rule))
         {
           /* We have found an 'include' line specifying a nested
              makefile to be read at this point.  */
@@ -865,6 +1105,9 @@ eval (struct ebuffer *ebuf, int set_default)
           /* "-include" (vs "include") says no error if the file does not
              exist.  "sinclude" is an alias for this from SGI.  */
           int noerror = (p[0] != 'i');
+          /* "include-deps" says the files are compiler-generated
+             dependency files, which we can often read more quickly.  */
+          int depfile = p[wlen - 1] == 's';
 
           /* Include ends the previous rule.  */
           record_waiting_files ();
@@ -898,6 +1141,7 @@ eval (struct ebuffer *ebuf, int set_default)
               struct nameseq *next = files->next;
               unsigned short flags = (RM_INCLUDED | RM_NO_TILDE
                                       | (noerror ? RM_DONTCARE : 0)
+                                      | (depfile ? RM_DEPFILE : 0)
                                       | (set_default ? 0 : RM_NO_DEFAULT_GOAL));
 
               struct goaldep *d = eval_makefile (files->name, flags);
@@ -1845,6 +2089,7 @@ record_target_var (struct nameseq *filenames, char *defn,
           if (gv && v != gv
               && (gv->origin == o_env_override || gv->origin == o_command))
             {
+              forget_expansion (v);
               free (v->value);
               v->value = xstrdup (gv->value);
               v->origin = gv->origin;
@@ -1960,6 +2205,13 @@ check_specials (struct nameseq *files, int set_default)
 static void
 check_special_file (struct file *file, const floc *flocp)
 {
+  if (streq (file->name, ".PURE"))
+    {
+      /* The set of pure functions may have changed.  */
+      ++pure_changenum;
+      return;
+    }
+
   if (streq (file->name, ".WAIT"))
     {
       static unsigned int wpre = 0, wcmd = 0;
@@ -2330,8 +2582,7 @@ find_map_unquote (char *string, int stopmap)
 
   while (1)
     {
-      while (! STOP_SET (*p, stopmap))
-        ++p;
+      p = find_stopchar (p, stopmap);
 
       if (*p == '\0')
         break;
@@ -2594,6 +2845,129 @@ readstring (struct ebuffer *ebuf)
   return 0;
 }
 
+/* Try to map the makefile open in EBUF into memory.  Lines are then copied
+   straight from the map into the buffer by readmap(), rather than through
+   stdio.  Return 1 if the makefile was mapped.  */
+
+static int
+map_makefile (struct ebuffer *ebuf)
+{
+#ifdef MAP_MAKEFILES
+  struct stat st;
+  size_t len;
+  void *map;
+
+  if (fstat (fileno (ebuf->fp), &st) != 0 || !S_ISREG (st.st_mode)
+      || st.st_size < MAP_MIN_SIZE || (uintmax_t) st.st_size >= SIZE_MAX)
+    return 0;
+
+  len = (size_t) st.st_size;
+  map = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fileno (ebuf->fp), 0);
+  if (map == MAP_FAILED)
+    return 0;
+
+  /* Leave files containing NULs to readline(), which warns about them.  */
+  if (memchr (map, '\0', len) != NULL)
+    {
+      munmap (map, len);
+      return 0;
+    }
+
+  ebuf->map = ebuf->mapnext = map;
+  ebuf->mapsize = len;
+
+  return 1;
+#else
+  (void) ebuf;
+  return 0;
+#endif
+}
+
+/* Read a line of text from a makefile mapped by map_makefile() into the
+   buffer.  This behaves exactly like reading it with readline(), but each
+   logical line is found with memchr() and copied only once.  */
+
+static long
+readmap (struct ebuffer *ebuf)
+{
+  const char *end = ebuf->map + ebuf->mapsize;
+  const char *start = ebuf->mapnext;
+  const char *eol;
+  size_t len;
+  long nlines = 0;
+  int crlf = 0;
+
+  if (start >= end)
+    return -1;
+
+  eol = start;
+  while (1)
+    {
+      int backslash = 0;
+      const char *bol = eol;
+      const char *p;
+
+      /* Find the next newline.  At the end of the map, we're done.  */
+      p = eol = memchr (eol, '\n', end - eol);
+      if (!eol)
+        {
+          eol = ebuf->mapnext = end;
+          break;
+        }
+
+      ++nlines;
+
+#if !MK_OS_W32 && !MK_OS_DOS && !MK_OS_OS2
+      /* Check to see if the line was really ended with CRLF.  */
+      if (p > bol && p[-1] == '\r')
+        {
+          --p;
+          crlf = 1;
+        }
+#endif
+
+      /* Found a newline; if it's escaped continue; else we're done.  */
+      while (p > bol && *(--p) == '\\')
+        backslash = !backslash;
+      if (!backslash)
+        {
+          ebuf->mapnext = eol + 1;
+          break;
+        }
+      ++eol;
+    }
+
+  len = eol - start;
+  if (len >= ebuf->size)
+    {
+      while (len >= ebuf->size)
+        ebuf->size *= 2;
+      ebuf->bufstart = xrealloc (ebuf->bufstart, ebuf->size);
+    }
+  ebuf->buffer = ebuf->bufstart;
+
+  if (!crlf)
+    {
+      memcpy (ebuf->buffer, start, len);
+      ebuf->buffer[len] = '\0';
+    }
+  else
+    {
+      /* Ignore the CR of each CRLF line ending.  */
+      char *d = ebuf->buffer;
+      const char *s;
+
+      if (eol < end && eol > start && eol[-1] == '\r')
+        --eol;
+      for (s = start; s < eol; ++s)
+        if (s[0] != '\r' || s[1] != '\n')
+          *(d++) = *s;
+      *d = '\0';
+    }
+
+  return nlines ? nlines : 1;
+}
+
 static long
 readline (struct ebuffer *ebuf)
 {
@@ -2608,6 +2982,9 @@ readline (struct ebuffer *ebuf)
   if (!ebuf->fp)
     return readstring (ebuf);
 
+  if (ebuf->map)
+    return readmap (ebuf);
+
   /* When reading from a file, we always start over at the beginning of the
      buffer for each new line.  */
 
@@ -3085,7 +3462,7 @@ parse_file_seq (char **stringp, size_t size, int stopmap,
   struct nameseq *new = 0;
   struct nameseq **newp = &new;
 #define NEWELT(_n)  do { \
-                        struct nameseq *_ns = xcalloc (size);       \
+                        struct nameseq *_ns = alloc_record (size);  \
                         const char *__n = (_n);                     \
                         _ns->name = (cachep ? strcache_add (__n) : xstrdup (__n)); \
                         if (found_wait) {                           \
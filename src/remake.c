@@ -22,6 +22,9 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "variable.h"
 #include "warning.h"
 #include "debug.h"
+#include "deplog.h"
+#include "statcache.h"
+#include "os.h"
 
 #include <assert.h>
 
@@ -361,6 +364,8 @@ update_file (struct file *file, unsigned int depth)
   enum update_status status = us_success;
   struct file *f;
 
+  snap_file_lazily (file);
+
   f = file->double_colon ? file->double_colon : file;
 
   /* Prune the dependency graph: if we've already been here on _this_
@@ -617,6 +622,8 @@ update_file_1 (struct file *file, unsigned int depth)
     {
       struct dep *lastd = 0;
 
+      snap_file_lazily (ad->file);
+
       /* Perform second expansion and enter each dependency name as a file.
          We only need to do this if second_expansion has been defined; if it
          hasn't then all deps were expanded as the makefile was read in.  */
@@ -640,6 +647,7 @@ update_file_1 (struct file *file, unsigned int depth)
             break;
 
           check_renamed (d->file);
+          snap_file_lazily (d->file);
 
           mtime = file_mtime (d->file);
           check_renamed (d->file);
@@ -1045,6 +1053,11 @@ notice_finished_file (struct file *file)
         }
     }
 
+  /* If the recipe wrote a dependency file, add it to the dependency log.  */
+  if (ran && file->cmds && file->update_status == us_success
+      && !question_flag && !just_print_flag && !touch_flag)
+    deplog_record (file);
+
   if (file->mtime_before_update == UNKNOWN_MTIME)
     file->mtime_before_update = file->last_mtime;
 
@@ -1150,6 +1163,7 @@ check_dep (struct file *file, unsigned int depth,
   struct dep *d;
   enum update_status dep_status = us_success;
 
+  snap_file_lazily (file);
   start_updating (file);
 
   /* We might change file if we find a different one via vpath;
@@ -1386,6 +1400,204 @@ remake_file (struct file *file)
   notice_finished_file (file);
 }
 
+/* Files looked at by prefetch_mtimes(), found by the address of their name.
+   What was found only holds until the first recipe is started.  */
+
+struct prefetched
+  {
+    const char *name;
+    struct os_stat st;
+  };
+
+static struct hash_table prefetched_files;
+static struct prefetched *prefetched;
+
+/* Don't bother starting threads for fewer files than this.  */
+#define PREFETCH_MIN 256
+
+static unsigned long
+prefetched_hash_1 (const void *key)
+{
+  return_ADDRESS_HASH_1 (((const struct prefetched *) key)->name);
+}
+
+static unsigned long
+prefetched_hash_2 (const void *key)
+{
+  return_ADDRESS_HASH_2 (((const struct prefetched *) key)->name);
+}
+
+static int
+prefetched_hash_cmp (const void *x, const void *y)
+{
+  const char *nx = ((const struct prefetched *) x)->name;
+  const char *ny = ((const struct prefetched *) y)->name;
+  return nx == ny ? 0 : nx < ny ? -1 : 1;
+}
+
+/* Return what prefetch_mtimes() found out about the file NAME, or NULL.  */
+
+static const struct os_stat *
+find_prefetched (const char *name)
+{
+  struct prefetched key;
+  const struct prefetched *p;
+
+  if (prefetched == NULL)
+    return NULL;
+
+  if (commands_started != 0)
+    {
+      hash_free (&prefetched_files, 0);
+      free (prefetched);
+      prefetched = NULL;
+      return NULL;
+    }
+
+  key.name = name;
+  p = hash_find_item (&prefetched_files, &key);
+  return p != NULL ? &p->st : NULL;
+}
+
+/* Return the ways os_stat_files() may look at files ahead of time, or 0 if
+   it shouldn't.  Unless .PREFETCH says otherwise, files are only looked at
+   ahead of time if the current directory is on a network file system:
+   elsewhere the answers come back so quickly that there's nothing to gain
+   from waiting for them together.  Setting .PREFETCH to io_uring uses the
+   ring even so, falling back to threads if it can't be set up.  */
+
+static unsigned int
+prefetch_how (void)
+{
+  unsigned int how = 0;
+  char *value;
+  const char *p;
+  const char *word;
+  size_t len;
+
+  if (lookup_variable (STRING_SIZE_TUPLE (".PREFETCH")) == NULL)
+    return os_remote_files () ? OS_STAT_URING | OS_STAT_THREADS : 0;
+
+  value = allocated_expand_variable (STRING_SIZE_TUPLE (".PREFETCH"));
+  p = value;
+  word = find_next_token (&p, &len);
+  if (word == NULL)
+    how = os_remote_files () ? OS_STAT_URING | OS_STAT_THREADS : 0;
+  else if (len == CSTRLEN ("threads") && strneq (word, "threads", len))
+    how = OS_STAT_THREADS;
+  else if (len == CSTRLEN ("io_uring") && strneq (word, "io_uring", len))
+    how = OS_STAT_URING | OS_STAT_THREADS;
+  else if (!(len == CSTRLEN ("no") && strneq (word, "no", len)))
+    OS (error, NILF, _("unknown .PREFETCH value: %s"), word);
+
+  free (value);
+  return how;
+}
+
+/* Look at all of the files the GOALS depend on at once, before update_file()
+   gets to them one at a time.  Where looking at a file takes a long time,
+   as it can on a network file system, this turns a walk which waits for each
+   file in turn into one which waits for them all together.  */
+
+void
+prefetch_mtimes (struct goaldep *goals)
+{
+  struct file **stack;
+  const char **names;
+  struct os_stat *results;
+  size_t nstack = 0, maxstack = 256;
+  size_t nnames = 0, maxnames = 256;
+  unsigned int how;
+  struct goaldep *g;
+  size_t i;
+
+  how = prefetch_how ();
+  if (how == 0)
+    return;
+
+  stack = xmalloc (maxstack * sizeof (struct file *));
+  names = xmalloc (maxnames * sizeof (const char *));
+
+  for (g = goals; g != 0; g = g->next)
+    {
+      if (nstack == maxstack)
+        {
+          maxstack *= 2;
+          stack = xrealloc (stack, maxstack * sizeof (struct file *));
+        }
+      stack[nstack++] = g->file;
+    }
+
+  /* Find each file which update_file() will want the timestamp of.  Files
+     left to be snapped as they're reached are snapped now, as update_file()
+     would, so that their .EXTRA_PREREQS are found too.  Files whose
+     prerequisites still need to be expanded are only looked at.  */
+  while (nstack > 0)
+    {
+      struct file *f = stack[--nstack];
+      FILE_TIMESTAMP mtime;
+      struct file *p;
+
+      check_renamed (f);
+      if (f->prefetch_seen)
+        continue;
+      f->prefetch_seen = 1;
+      snap_file_lazily (f);
+
+      if (f->last_mtime == UNKNOWN_MTIME && !f->phony
+#ifndef NO_ARCHIVES
+          && !ar_name (f->name)
+#endif
+          && !statcache_find (f->name, &mtime))
+        {
+          if (nnames == maxnames)
+            {
+              maxnames *= 2;
+              names = xrealloc (names, maxnames * sizeof (const char *));
+            }
+          names[nnames++] = f->name;
+        }
+
+      for (p = f->double_colon ? f->double_colon : f; p != 0; p = p->prev)
+        {
+          struct dep *d;
+
+          for (d = p->deps; d != 0; d = d->next)
+            if (d->file != 0 && !d->file->prefetch_seen)
+              {
+                if (nstack == maxstack)
+                  {
+                    maxstack *= 2;
+                    stack = xrealloc (stack, maxstack * sizeof (struct file *));
+                  }
+                stack[nstack++] = d->file;
+              }
+        }
+    }
+  free (stack);
+
+  results = xmalloc ((nnames ? nnames : 1) * sizeof (struct os_stat));
+  if (nnames >= PREFETCH_MIN
+      && os_stat_files (nnames, names, results, how))
+    {
+      DB (DB_VERBOSE, (_("Looked at %lu files ahead of time.\n"),
+                       (unsigned long) nnames));
+
+      prefetched = xmalloc (nnames * sizeof (struct prefetched));
+      hash_init (&prefetched_files, nnames, prefetched_hash_1,
+                 prefetched_hash_2, prefetched_hash_cmp);
+      for (i = 0; i < nnames; ++i)
+        {
+          prefetched[i].name = names[i];
+          prefetched[i].st = results[i];
+          hash_insert (&prefetched_files, &prefetched[i]);
+        }
+    }
+
+  free (results);
+  free (names);
+}
+
 /* Return the mtime of a file, given a 'struct file'.
    Caches the time in the struct file to avoid excess stat calls.
 
@@ -1474,7 +1686,9 @@ f_mtime (struct file *file, int search)
   else
 #endif
     {
-      mtime = name_mtime (file->name);
+      /* A file we updated must be looked at again.  */
+      if (file->updated || !statcache_find (file->name, &mtime))
+        mtime = name_mtime (file->name);
 
       if (mtime == NONEXISTENT_MTIME && search && !file->ignore_vpath)
         {
@@ -1616,6 +1830,9 @@ name_mtime (const char *name)
 #else
   struct stat st;
 #endif
+  const struct os_stat *pf = NULL;
+  uintmax_t ino = 0;
+  uintmax_t size = 0;
   int e;
 
 #if MK_OS_W32
@@ -1659,10 +1876,29 @@ name_mtime (const char *name)
       }
   }
 #else
-  EINTRLOOP (e, stat (name, &st));
+  pf = find_prefetched (name);
+  if (pf == NULL)
+    EINTRLOOP (e, stat (name, &st));
+  else if (pf->err == 0)
+    e = 0;
+  else
+    {
+      errno = pf->err;
+      e = -1;
+    }
 #endif
-  if (e == 0)
-    mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
+  if (e == 0 && pf != NULL)
+    {
+      mtime = file_timestamp_cons (name, pf->mtime, pf->mtime_ns);
+      ino = pf->ino;
+      size = pf->size;
+    }
+  else if (e == 0)
+    {
+      mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
+      ino = st.st_ino;
+      size = st.st_size;
+    }
   else if (errno == ENOENT || errno == ENOTDIR)
     mtime = NONEXISTENT_MTIME;
   else
@@ -1671,6 +1907,8 @@ name_mtime (const char *name)
       return NONEXISTENT_MTIME;
     }
 
+  statcache_note (name, mtime, ino, size);
+
   /* If we get here we either found it, or it doesn't exist.
      If it doesn't exist see if we can use a symlink mtime instead.  */
 
@@ -0,0 +1,151 @@
+/* SHA-1 message digests for GNU Make.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#include "sha1.h"
+
+/* SHA-1 as described in FIPS 180-4.  It's used by $(file-hash ...) to give
+   the same digests as the sha1sum program, not for security.  Values are kept
+   in unsigned longs, which may be wider than the 32 bits the algorithm
+   works in, so results are masked where they could overflow.  */
+
+#define MASK32(x)   ((x) & 0xffffffffUL)
+#define ROL32(x, n) MASK32 (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_block (struct sha1_ctx *ctx, const unsigned char *p)
+{
+  unsigned long w[80];
+  unsigned long a, b, c, d, e;
+  int i;
+
+  for (i = 0; i < 16; ++i)
+    w[i] = ((unsigned long) p[4 * i] << 24 | (unsigned long) p[4 * i + 1] << 16
+            | (unsigned long) p[4 * i + 2] << 8 | (unsigned long) p[4 * i + 3]);
+  for (; i < 80; ++i)
+    w[i] = ROL32 (w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  a = ctx->h[0];
+  b = ctx->h[1];
+  c = ctx->h[2];
+  d = ctx->h[3];
+  e = ctx->h[4];
+
+  for (i = 0; i < 80; ++i)
+    {
+      unsigned long f, k, t;
+
+      if (i < 20)
+        {
+          f = (b & c) | (~b & d);
+          k = 0x5a827999UL;
+        }
+      else if (i < 40)
+        {
+          f = b ^ c ^ d;
+          k = 0x6ed9eba1UL;
+        }
+      else if (i < 60)
+        {
+          f = (b & c) | (b & d) | (c & d);
+          k = 0x8f1bbcdcUL;
+        }
+      else
+        {
+          f = b ^ c ^ d;
+          k = 0xca62c1d6UL;
+        }
+
+      t = MASK32 (ROL32 (a, 5) + MASK32 (f) + e + k + w[i]);
+      e = d;
+      d = c;
+      c = ROL32 (b, 30);
+      b = a;
+      a = t;
+    }
+
+  ctx->h[0] = MASK32 (ctx->h[0] + a);
+  ctx->h[1] = MASK32 (ctx->h[1] + b);
+  ctx->h[2] = MASK32 (ctx->h[2] + c);
+  ctx->h[3] = MASK32 (ctx->h[3] + d);
+  ctx->h[4] = MASK32 (ctx->h[4] + e);
+}
+
+void
+sha1_init (struct sha1_ctx *ctx)
+{
+  ctx->h[0] = 0x67452301UL;
+  ctx->h[1] = 0xefcdab89UL;
+  ctx->h[2] = 0x98badcfeUL;
+  ctx->h[3] = 0x10325476UL;
+  ctx->h[4] = 0xc3d2e1f0UL;
+  ctx->length = 0;
+  ctx->used = 0;
+}
+
+void
+sha1_update (struct sha1_ctx *ctx, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+
+  ctx->length += len;
+
+  if (ctx->used)
+    {
+      size_t n = 64 - ctx->used;
+      if (n > len)
+        n = len;
+      memcpy (ctx->block + ctx->used, p, n);
+      ctx->used += n;
+      p += n;
+      len -= n;
+      if (ctx->used < 64)
+        return;
+      sha1_block (ctx, ctx->block);
+      ctx->used = 0;
+    }
+
+  for (; len >= 64; p += 64, len -= 64)
+    sha1_block (ctx, p);
+
+  memcpy (ctx->block, p, len);
+  ctx->used = len;
+}
+
+/* Finish the digest and store its SHA1_DIGEST_SIZE bytes in DIGEST.  */
+
+void
+sha1_final (struct sha1_ctx *ctx, unsigned char *digest)
+{
+  uintmax_t bits = ctx->length * 8;
+  int i;
+
+  ctx->block[ctx->used++] = 0x80;
+  if (ctx->used > 56)
+    {
+      memset (ctx->block + ctx->used, 0, 64 - ctx->used);
+      sha1_block (ctx, ctx->block);
+      ctx->used = 0;
+    }
+  memset (ctx->block + ctx->used, 0, 56 - ctx->used);
+  for (i = 0; i < 8; ++i)
+    ctx->block[63 - i] = (unsigned char) ((bits >> (8 * i)) & 0xff);
+  sha1_block (ctx, ctx->block);
+
+  for (i = 0; i < 20; ++i)
+    digest[i] = (unsigned char) ((ctx->h[i / 4] >> (24 - 8 * (i % 4))) & 0xff);
+}
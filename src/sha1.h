@@ -0,0 +1,29 @@
+/* Declarations for SHA-1 message digests.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#define SHA1_DIGEST_SIZE 20
+
+struct sha1_ctx
+  {
+    unsigned long h[5];         /* The intermediate hash value.  */
+    uintmax_t length;           /* Bytes processed so far.  */
+    unsigned char block[64];    /* Bytes waiting for a full block.  */
+    size_t used;                /* Number of bytes in BLOCK.  */
+  };
+
+void sha1_init (struct sha1_ctx *ctx);
+void sha1_update (struct sha1_ctx *ctx, const void *data, size_t len);
+void sha1_final (struct sha1_ctx *ctx, unsigned char *digest);
@@ -0,0 +1,244 @@
+/* Cache of $(shell-cached ...) results for GNU Make.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#include "shcache.h"
+
+#include "applog.h"
+#include "variable.h"
+#include "debug.h"
+#include "hash.h"
+
+/* The shell cache remembers the output of commands run by $(shell-cached),
+   so that later runs of make can reuse it without running the command.
+
+   Each result is stored under a key, which identifies the command, along with
+   a state, which describes everything else it depends on.  A result is only
+   reused if both match.  The caller decides what goes into them.
+
+   The cache file starts with SHCACHE_MAGIC, followed by any number of
+   records, in the form described in applog.c.  Each record holds the 4-byte
+   length of the key, the key, the 4-byte length of the state, the state,
+   then the output.  New records are appended as
+   commands are run and the last record for a key wins.  A truncated record at
+   the end of the file is cut off when the file is read.  */
+
+#define SHCACHE_DEFAULT  ".make.shell"
+#define SHCACHE_MAGIC    "GNU make shell cache 1\n"
+
+/* Rewrite the cache when it has at least this many records and more than
+   half of them have been superseded by later ones.  */
+#define SHCACHE_COMPACT_MIN 100
+
+struct shcache_entry
+  {
+    const char *key;
+    size_t keylen;
+    const char *state;
+    size_t statelen;
+    const char *output;
+    size_t outlen;
+  };
+
+static struct hash_table shcache_table;
+
+/* The contents of the cache file, which entries may point into.  */
+static char *shcache_buf = NULL;
+
+/* Set if the cache exists but can't be used: we won't append to it.  */
+static int shcache_unusable = 0;
+
+static unsigned long
+shcache_hash_1 (const void *key)
+{
+  const struct shcache_entry *e = key;
+  return_STRING_N_HASH_1 (e->key, e->keylen);
+}
+
+static unsigned long
+shcache_hash_2 (const void *key)
+{
+  const struct shcache_entry *e = key;
+  return_STRING_N_HASH_2 (e->key, e->keylen);
+}
+
+static int
+shcache_hash_cmp (const void *x, const void *y)
+{
+  const struct shcache_entry *ex = x;
+  const struct shcache_entry *ey = y;
+
+  if (ex->keylen != ey->keylen)
+    return ex->keylen < ey->keylen ? -1 : 1;
+  return_STRING_N_COMPARE (ex->key, ey->key, ex->keylen);
+}
+
+/* Return the name of the shell cache.  */
+
+static const char *
+shcache_name (void)
+{
+  static char *name = NULL;
+
+  if (name == NULL)
+    {
+      name = applog_variable (STRING_SIZE_TUPLE (".SHELLCACHE"));
+      if (name == NULL)
+        name = xstrdup (SHCACHE_DEFAULT);
+    }
+
+  return name;
+}
+
+/* Write a record for the shcache_entry ITEM to FP.  Return 0 on failure.  */
+
+static int
+write_record (FILE *fp, const void *item)
+{
+  const struct shcache_entry *entry = item;
+  char hdr[4];
+  char klen[4];
+  char slen[4];
+
+  applog_put_length (hdr, 8 + entry->keylen + entry->statelen + entry->outlen);
+  applog_put_length (klen, entry->keylen);
+  applog_put_length (slen, entry->statelen);
+  return (fwrite (hdr, 1, sizeof (hdr), fp) == sizeof (hdr)
+          && fwrite (klen, 1, sizeof (klen), fp) == sizeof (klen)
+          && fwrite (entry->key, 1, entry->keylen, fp) == entry->keylen
+          && fwrite (slen, 1, sizeof (slen), fp) == sizeof (slen)
+          && fwrite (entry->state, 1, entry->statelen, fp) == entry->statelen
+          && fwrite (entry->output, 1, entry->outlen, fp) == entry->outlen);
+}
+
+/* Add the record of LEN bytes at REC to the cache.  */
+
+static int
+read_record (const char *rec, unsigned long len, void *arg UNUSED)
+{
+  struct shcache_entry *entry;
+  unsigned long klen, slen;
+
+  if (len < 8)
+    return 0;
+  klen = applog_get_length (rec);
+  if (klen > len - 8)
+    return 0;
+  slen = applog_get_length (rec + 4 + klen);
+  if (slen > len - 8 - klen)
+    return 0;
+
+  entry = xmalloc (sizeof (struct shcache_entry));
+  entry->key = rec + 4;
+  entry->keylen = klen;
+  entry->state = rec + 8 + klen;
+  entry->statelen = slen;
+  entry->output = entry->state + slen;
+  entry->outlen = rec + len - entry->output;
+
+  free (hash_insert (&shcache_table, entry));
+  return 1;
+}
+
+/* Read the shell cache, if there is one.  */
+
+static void
+load_cache (void)
+{
+  struct applog log;
+  int r;
+
+  hash_init (&shcache_table, 64, shcache_hash_1, shcache_hash_2,
+             shcache_hash_cmp);
+
+  log.name = shcache_name ();
+  log.magic = SHCACHE_MAGIC;
+  log.hdrlen = 0;
+  log.badfmt = _("%s: unrecognized shell cache format; ignoring");
+  log.cut = 1;
+
+  r = applog_read (&log, read_record, NULL);
+  if (r < 0)
+    shcache_unusable = 1;
+  if (log.buf == NULL)
+    return;
+
+  shcache_buf = log.buf;
+  DB (DB_VERBOSE, (_("Reading shell cache '%s'...\n"), log.name));
+
+  if (r > 0 && log.nrecords >= SHCACHE_COMPACT_MIN
+      && log.nrecords > 2 * shcache_table.ht_fill)
+    {
+      DB (DB_VERBOSE, (_("Compacting shell cache '%s'\n"), log.name));
+      applog_rewrite (log.name, SHCACHE_MAGIC, write_record, &shcache_table);
+    }
+}
+
+/* Look for a cached result for the command identified by the KEYLEN bytes of
+   KEY.  If there is one whose state matches the STATELEN bytes of STATE,
+   return its output and store its length in *LENP.  Otherwise return NULL.  */
+
+const char *
+shcache_find (const char *key, size_t keylen,
+              const char *state, size_t statelen, size_t *lenp)
+{
+  struct shcache_entry lookup;
+  const struct shcache_entry *entry;
+
+  if (shcache_table.ht_vec == NULL)
+    load_cache ();
+
+  lookup.key = key;
+  lookup.keylen = keylen;
+  entry = hash_find_item (&shcache_table, &lookup);
+  if (entry == NULL || entry->statelen != statelen
+      || memcmp (entry->state, state, statelen) != 0)
+    return NULL;
+
+  *lenp = entry->outlen;
+  return entry->output;
+}
+
+/* Remember that the command identified by KEY produced OUTPUT, when run in
+   the given STATE.  The result is added to the cache file.  */
+
+void
+shcache_store (const char *key, size_t keylen,
+               const char *state, size_t statelen,
+               const char *output, size_t outlen)
+{
+  struct shcache_entry *entry;
+  char *p;
+
+  if (shcache_table.ht_vec == NULL)
+    load_cache ();
+
+  entry = xmalloc (sizeof (struct shcache_entry) + keylen + statelen + outlen);
+  p = (char *) (entry + 1);
+  entry->key = memcpy (p, key, keylen);
+  entry->keylen = keylen;
+  entry->state = memcpy (p + keylen, state, statelen);
+  entry->statelen = statelen;
+  entry->output = memcpy (p + keylen + statelen, output, outlen);
+  entry->outlen = outlen;
+
+  free (hash_insert (&shcache_table, entry));
+
+  if (!shcache_unusable
+      && !applog_append (shcache_name (), SHCACHE_MAGIC, write_record, entry))
+    shcache_unusable = 1;
+}
@@ -0,0 +1,21 @@
+/* Declarations for the $(shell-cached ...) result cache.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+const char *shcache_find (const char *key, size_t keylen,
+                          const char *state, size_t statelen, size_t *lenp);
+void shcache_store (const char *key, size_t keylen,
+                    const char *state, size_t statelen,
+                    const char *output, size_t outlen);
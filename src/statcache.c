@@ -0,0 +1,478 @@
+/* Persistent cache of file timestamps for GNU Make.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#include "filedef.h"
+#include "statcache.h"
+
+#include "applog.h"
+#include "debug.h"
+#include "hash.h"
+
+/* The stat cache remembers what stat() said about each file make looked at,
+   so that later runs can skip the call.  It is only used if the variable
+   .STATCACHE names the file to keep it in.
+
+   Along with each file's timestamp, inode number and size, the cache records
+   the timestamp of the directory containing it, taken just before the file
+   was examined.  Creating, removing or renaming a file changes the timestamp
+   of its directory, so as long as the directory's timestamp is unchanged the
+   cached answer for the file is trusted and only the directory is examined.
+   Rewriting a file in place does NOT change its directory: that is the price
+   of the shortcut.  If .STATCACHE_STRICT is not empty every file is examined
+   anyway, and any file whose cached answer would have been wrong is reported
+   by "make --debug=v".
+
+   An answer is only trusted if the directory's timestamp is comfortably older
+   than the run that recorded it, since a directory changed within the same
+   tick of its clock could be changed again without its timestamp moving.
+   Nothing is trusted once this run has started a recipe: the recipe could
+   have rewritten any file, whether make knows about it or not.
+
+   The cache file starts with STATCACHE_MAGIC and the 8-byte time the run
+   that wrote it started, followed by any number of records, in the form
+   described in applog.c.  Each record holds the file's timestamp, its
+   directory's timestamp, its inode number and its size, 8 bytes each, then
+   the name of the file.  All numbers are little-endian.
+
+   The whole file is rewritten at the end of any run that learned something
+   new.  It is rewritten in place, under a lock, rather than replaced: a new
+   file would change the timestamp of its directory, and so the cache would
+   never be trusted for any of the files next to it.  */
+
+#define STATCACHE_MAGIC  "GNU make stat cache 1\n"
+
+/* The size of the fixed part of each record.  */
+#define STATCACHE_FIXED  32
+
+/* Only trust directories whose timestamp is at least this many seconds older
+   than the run that looked at them.  */
+#define STATCACHE_RACY_S 2
+
+struct statcache_entry
+  {
+    const char *name;
+    size_t len;
+    FILE_TIMESTAMP mtime;
+    FILE_TIMESTAMP dir_mtime;
+    uintmax_t ino;
+    uintmax_t size;
+    unsigned int trusted:1;     /* Read from the cache and old enough.  */
+    unsigned int noted:1;       /* Examined in this run.  */
+    unsigned int predicted:1;   /* Would have been trusted in strict mode.  */
+  };
+
+/* A directory examined in this run.  */
+struct statcache_dir
+  {
+    const char *name;
+    size_t len;
+    FILE_TIMESTAMP mtime;
+    unsigned long counter;      /* The value of command_count at the time.  */
+  };
+
+static struct hash_table statcache_table;
+static struct hash_table statcache_dirs;
+
+/* The name of the cache, or NULL if there is none.  */
+static char *statcache_file = NULL;
+
+/* The contents of the cache file, which entries may point into.  */
+static char *statcache_buf = NULL;
+
+/* Nonzero once we know whether the cache is used.  */
+static int statcache_checked = 0;
+
+static int statcache_strict = 0;
+
+/* Set when there is something new to write back.  */
+static int statcache_dirty = 0;
+
+/* When this run started looking at files.  */
+static FILE_TIMESTAMP statcache_start;
+
+static unsigned long
+statcache_hash_1 (const void *key)
+{
+  const struct statcache_entry *e = key;
+  return_STRING_N_HASH_1 (e->name, e->len);
+}
+
+static unsigned long
+statcache_hash_2 (const void *key)
+{
+  const struct statcache_entry *e = key;
+  return_STRING_N_HASH_2 (e->name, e->len);
+}
+
+static int
+statcache_hash_cmp (const void *x, const void *y)
+{
+  const struct statcache_entry *ex = x;
+  const struct statcache_entry *ey = y;
+
+  if (ex->len != ey->len)
+    return ex->len < ey->len ? -1 : 1;
+  return_STRING_N_COMPARE (ex->name, ey->name, ex->len);
+}
+
+static unsigned long
+dir_hash_1 (const void *key)
+{
+  const struct statcache_dir *d = key;
+  return_STRING_N_HASH_1 (d->name, d->len);
+}
+
+static unsigned long
+dir_hash_2 (const void *key)
+{
+  const struct statcache_dir *d = key;
+  return_STRING_N_HASH_2 (d->name, d->len);
+}
+
+static int
+dir_hash_cmp (const void *x, const void *y)
+{
+  const struct statcache_dir *dx = x;
+  const struct statcache_dir *dy = y;
+
+  if (dx->len != dy->len)
+    return dx->len < dy->len ? -1 : 1;
+  return_STRING_N_COMPARE (dx->name, dy->name, dx->len);
+}
+
+static uintmax_t
+get_number (const char *p)
+{
+  const unsigned char *u = (const unsigned char *) p;
+  uintmax_t n = 0;
+  int i;
+
+  for (i = 7; i >= 0; --i)
+    n = (n << 8) | u[i];
+  return n;
+}
+
+static void
+put_number (char *p, uintmax_t n)
+{
+  int i;
+
+  for (i = 0; i < 8; ++i, n >>= 8)
+    p[i] = (char) (n & 0xff);
+}
+
+/* Add the record of LEN bytes at REC, from the applog ARG, to the cache.  */
+
+static int
+read_record (const char *rec, unsigned long len, void *arg)
+{
+  const struct applog *log = arg;
+  FILE_TIMESTAMP written = get_number (log->buf + CSTRLEN (STATCACHE_MAGIC));
+  struct statcache_entry *entry;
+
+  if (len <= STATCACHE_FIXED)
+    return 0;
+
+  entry = xcalloc (sizeof (struct statcache_entry));
+  entry->mtime = get_number (rec);
+  entry->dir_mtime = get_number (rec + 8);
+  entry->ino = get_number (rec + 16);
+  entry->size = get_number (rec + 24);
+  entry->name = rec + STATCACHE_FIXED;
+  entry->len = len - STATCACHE_FIXED;
+  entry->trusted = (is_ordinary_mtime (entry->dir_mtime)
+                    && is_ordinary_mtime (written)
+                    && (FILE_TIMESTAMP_S (entry->dir_mtime) + STATCACHE_RACY_S
+                        <= FILE_TIMESTAMP_S (written)));
+
+  free (hash_insert (&statcache_table, entry));
+  return 1;
+}
+
+/* Read the stat cache, if there is one.  */
+
+static void
+load_cache (void)
+{
+  struct applog log;
+
+  /* The header holds the time the cache was written.  */
+  log.name = statcache_file;
+  log.magic = STATCACHE_MAGIC;
+  log.hdrlen = 8;
+  log.badfmt = _("%s: unrecognized stat cache format; ignoring");
+  log.cut = 0;
+
+  if (applog_read (&log, read_record, &log) > 0)
+    {
+      statcache_buf = log.buf;
+      DB (DB_VERBOSE, (_("Reading stat cache '%s'...\n"), statcache_file));
+    }
+}
+
+/* Decide whether the cache is used, and read it if so.  */
+
+static void
+init_cache (void)
+{
+  char *strict;
+  int resolution;
+
+  statcache_checked = 1;
+
+  /* With -L the timestamp of a file depends on the symlinks leading to it,
+     which the cache knows nothing about.  */
+  if (check_symlink_flag)
+    return;
+
+  statcache_file = applog_variable (STRING_SIZE_TUPLE (".STATCACHE"));
+  if (statcache_file == NULL)
+    return;
+
+  strict = applog_variable (STRING_SIZE_TUPLE (".STATCACHE_STRICT"));
+  statcache_strict = strict != NULL;
+  free (strict);
+
+  statcache_start = file_timestamp_now (&resolution);
+
+  hash_init (&statcache_table, 1024, statcache_hash_1, statcache_hash_2,
+             statcache_hash_cmp);
+  hash_init (&statcache_dirs, 64, dir_hash_1, dir_hash_2, dir_hash_cmp);
+
+  load_cache ();
+}
+
+/* Find the directory containing the file NAME.  If LOOK is nonzero, examine
+   it if it has not been examined since the last command was run.  Return
+   NULL if it has never been examined.  */
+
+static struct statcache_dir *
+containing_dir (const char *name, size_t len, int look)
+{
+  struct statcache_dir lookup;
+  struct statcache_dir *dir;
+  struct statcache_dir **slot;
+  const char *p = name + len;
+
+  while (p > name && !ISDIRSEP (p[-1]))
+    --p;
+  if (p == name)
+    {
+      lookup.name = ".";
+      lookup.len = 1;
+    }
+  else
+    {
+      lookup.name = name;
+      lookup.len = p - name == 1 ? 1 : p - name - 1;
+    }
+
+  slot = (struct statcache_dir **) hash_find_slot (&statcache_dirs, &lookup);
+  dir = *slot;
+  if (HASH_VACANT (dir))
+    {
+      if (!look)
+        return NULL;
+      dir = xmalloc (sizeof (struct statcache_dir));
+      dir->name = strcache_add_len (lookup.name, lookup.len);
+      dir->len = lookup.len;
+      dir->counter = command_count - 1;
+      hash_insert_at (&statcache_dirs, dir, slot);
+    }
+
+  if (look && dir->counter != command_count)
+    {
+      struct stat st;
+      int e;
+
+      EINTRLOOP (e, stat (dir->name, &st));
+      dir->mtime = e == 0 ? FILE_TIMESTAMP_STAT_MODTIME (dir->name, st)
+                          : NONEXISTENT_MTIME;
+      dir->counter = command_count;
+    }
+
+  return dir;
+}
+
+/* If the cache knows the timestamp of the file NAME, store it in *MTIMEP and
+   return 1.  Otherwise return 0: the caller will examine the file, and tell
+   us what it found with statcache_note().  */
+
+int
+statcache_find (const char *name, FILE_TIMESTAMP *mtimep)
+{
+  struct statcache_entry lookup;
+  struct statcache_entry *entry;
+  struct statcache_dir *dir;
+
+  if (!statcache_checked)
+    init_cache ();
+  if (statcache_file == NULL)
+    return 0;
+
+  /* Always look at the directory first, so that we can record the file.  */
+  lookup.name = name;
+  lookup.len = strlen (name);
+  dir = containing_dir (lookup.name, lookup.len, 1);
+
+  entry = hash_find_item (&statcache_table, &lookup);
+  if (entry == NULL || !entry->trusted || commands_started != 0
+      || !is_ordinary_mtime (dir->mtime) || entry->dir_mtime != dir->mtime)
+    return 0;
+
+  if (statcache_strict)
+    {
+      entry->predicted = 1;
+      return 0;
+    }
+
+  *mtimep = entry->mtime;
+  return 1;
+}
+
+/* Remember that the file NAME had the timestamp MTIME, inode number INO and
+   size SIZE, or didn't exist if MTIME is NONEXISTENT_MTIME.  */
+
+void
+statcache_note (const char *name, FILE_TIMESTAMP mtime,
+                uintmax_t ino, uintmax_t size)
+{
+  struct statcache_entry lookup;
+  struct statcache_entry *entry;
+  struct statcache_entry **slot;
+  struct statcache_dir *dir;
+
+  if (statcache_file == NULL)
+    return;
+
+  /* Only a directory examined before the file vouches for it.  */
+  lookup.name = name;
+  lookup.len = strlen (name);
+  dir = containing_dir (lookup.name, lookup.len, 0);
+  if (dir == NULL)
+    return;
+
+  slot = (struct statcache_entry **) hash_find_slot (&statcache_table,
+                                                     &lookup);
+  entry = *slot;
+  if (!HASH_VACANT (entry))
+    {
+      if (entry->predicted)
+        {
+          entry->predicted = 0;
+          if (entry->mtime != mtime || entry->ino != ino
+              || entry->size != size)
+            DB (DB_VERBOSE, (_("Stat cache entry for '%s' is out of date.\n"),
+                             name));
+        }
+      if (entry->trusted && entry->mtime == mtime
+          && entry->dir_mtime == dir->mtime
+          && entry->ino == ino && entry->size == size)
+        {
+          entry->noted = 1;
+          return;
+        }
+    }
+  else
+    {
+      char *copy = xmalloc (sizeof (struct statcache_entry) + lookup.len);
+
+      entry = (struct statcache_entry *) copy;
+      memset (entry, '\0', sizeof (struct statcache_entry));
+      entry->name = memcpy (copy + sizeof (struct statcache_entry),
+                            name, lookup.len);
+      entry->len = lookup.len;
+      hash_insert_at (&statcache_table, entry, slot);
+    }
+
+  entry->mtime = mtime;
+  entry->dir_mtime = dir->mtime;
+  entry->ino = ino;
+  entry->size = size;
+  entry->noted = 1;
+  statcache_dirty = 1;
+}
+
+/* Write the stat cache back, if this run learned anything new.  */
+
+void
+statcache_save (void)
+{
+  struct statcache_entry **entries;
+  struct statcache_entry **ep;
+  char buf[STATCACHE_FIXED + 4];
+  FILE *fp;
+  int ok;
+  int e;
+
+  if (statcache_file == NULL || !statcache_dirty)
+    return;
+  statcache_dirty = 0;
+
+  DB (DB_VERBOSE, (_("Writing stat cache '%s'\n"), statcache_file));
+
+  ENULLLOOP (fp, fopen (statcache_file, "r+b"));
+  if (fp == NULL && errno == ENOENT)
+    ENULLLOOP (fp, fopen (statcache_file, "wb"));
+  if (fp == NULL)
+    {
+      perror_with_name ("fopen: ", statcache_file);
+      return;
+    }
+
+  /* Other makes could be reading or writing the same cache.  */
+  applog_lock (fileno (fp), 1);
+
+  put_number (buf, statcache_start);
+  ok = (fwrite (STATCACHE_MAGIC, 1, CSTRLEN (STATCACHE_MAGIC), fp)
+        == CSTRLEN (STATCACHE_MAGIC)
+        && fwrite (buf, 1, 8, fp) == 8);
+
+  /* Entries from earlier runs that were not trusted then can't be trusted
+     later either, unless they are examined again.  */
+  entries = (struct statcache_entry **) hash_dump (&statcache_table,
+                                                   NULL, NULL);
+  for (ep = entries; ok && *ep != NULL; ++ep)
+    {
+      const struct statcache_entry *entry = *ep;
+
+      if (!entry->noted && !entry->trusted)
+        continue;
+
+      applog_put_length (buf, STATCACHE_FIXED + entry->len);
+      put_number (buf + 4, entry->mtime);
+      put_number (buf + 12, entry->dir_mtime);
+      put_number (buf + 20, entry->ino);
+      put_number (buf + 28, entry->size);
+      ok = (fwrite (buf, 1, sizeof (buf), fp) == sizeof (buf)
+            && fwrite (entry->name, 1, entry->len, fp) == entry->len);
+    }
+  free (entries);
+
+  /* If anything went wrong, leave an empty cache rather than a bad one.  */
+  if (ok && fflush (fp) == 0)
+    EINTRLOOP (e, ftruncate (fileno (fp), ftell (fp)));
+  else
+    {
+      ok = 0;
+      EINTRLOOP (e, ftruncate (fileno (fp), 0));
+    }
+
+  if (fclose (fp) != 0 || !ok)
+    perror_with_name ("", statcache_file);
+}
@@ -0,0 +1,20 @@
+/* Declarations for the persistent cache of file timestamps.
+Copyright (C) 2024 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+int statcache_find (const char *name, FILE_TIMESTAMP *mtimep);
+void statcache_note (const char *name, FILE_TIMESTAMP mtime,
+                     uintmax_t ino, uintmax_t size);
+void statcache_save (void);
@@ -27,6 +27,11 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 typedef unsigned short int sc_buflen_t;
 
+/* Each string is preceded by room for its hash in the tables of cached names
+   (see strcache_hash).  0 means it isn't known yet.  The space isn't aligned,
+   so it's accessed with memcpy.  */
+#define SC_HASH_SIZE            (sizeof (unsigned int))
+
 struct strcache {
   struct strcache *next;    /* The next block of strings.  Must be first!  */
   sc_buflen_t end;          /* Offset to the beginning of free space.  */
@@ -75,10 +80,12 @@ static const char *
 copy_string (struct strcache *sp, const char *str, sc_buflen_t len)
 {
   /* Add the string to this cache.  */
-  char *res = &sp->buffer[sp->end];
+  char *res = &sp->buffer[sp->end] + SC_HASH_SIZE;
 
+  memset (res - SC_HASH_SIZE, 0, SC_HASH_SIZE);
   memmove (res, str, len);
   res[len++] = '\0';
+  len += SC_HASH_SIZE;
   sp->end += len;
   sp->bytesfree -= len;
   ++sp->count;
@@ -92,8 +99,8 @@ add_string (const char *str, sc_buflen_t len)
   const char *res;
   struct strcache *sp;
   struct strcache **spp = &strcache;
-  /* We need space for the nul char.  */
-  sc_buflen_t sz = len + 1;
+  /* We need space for the hash and the nul char.  */
+  sc_buflen_t sz = len + 1 + SC_HASH_SIZE;
 
   ++total_strings;
   total_size += sz;
@@ -145,14 +152,18 @@ static struct hugestring *hugestrings = NULL;
 static const char *
 add_hugestring (const char *str, size_t len)
 {
-  struct hugestring *new = xmalloc (sizeof (struct hugestring) + len);
-  memcpy (new->buffer, str, len);
-  new->buffer[len] = '\0';
+  struct hugestring *new = xmalloc (sizeof (struct hugestring)
+                                    + SC_HASH_SIZE + len);
+  char *res = new->buffer + SC_HASH_SIZE;
+
+  memset (new->buffer, 0, SC_HASH_SIZE);
+  memcpy (res, str, len);
+  res[len] = '\0';
 
   new->next = hugestrings;
   hugestrings = new;
 
-  return new->buffer;
+  return res;
 }
 
 /* Hash table of strings in the cache.  */
@@ -169,6 +180,12 @@ str_hash_2 (const void *key)
   return_ISTRING_HASH_2 ((const char *) key);
 }
 
+static unsigned long
+stable_hash (const char *str)
+{
+  return_STABLE_ISTRING_HASH_1 (str);
+}
+
 static int
 str_hash_cmp (const void *x, const void *y)
 {
@@ -186,11 +203,17 @@ add_hash (const char *str, size_t len)
 
   /* If it's too large for the string cache, just copy it.
      We don't bother trying to match these.  */
-  if (len > USHRT_MAX - 1)
+  if (len > USHRT_MAX - 1 - SC_HASH_SIZE)
     return add_hugestring (str, len);
 
   /* Look up the string in the hash.  If it's there, return it.  */
+#ifdef HAVE_CASE_INSENSITIVE_FS
   slot = (char *const *) hash_find_slot (&strings, str);
+#else
+  /* We already know the length: don't make str_hash_1 find it again.  */
+  slot = (char *const *) hash_find_slot_hash (&strings, str,
+                                              hash_bytes (str, len));
+#endif
   key = *slot;
 
   /* Count the total number of add operations we performed.  */
@@ -221,7 +244,7 @@ strcache_iscached (const char *str)
   {
     struct hugestring *hp;
     for (hp = hugestrings; hp != 0; hp = hp->next)
-      if (str == hp->buffer)
+      if (str == hp->buffer + SC_HASH_SIZE)
         return 1;
   }
 
@@ -253,6 +276,26 @@ strcache_add_len (const char *str, size_t len)
   return add_hash (str, len);
 }
 
+/* Return the hash of STR, which must be in the cache, for tables keyed by
+   cached names (see return_STABLE_ISTRING_HASH_1).  It is only computed the
+   first time it's asked for: after that finding a file with a cached name
+   costs no hashing at all.  */
+unsigned long
+strcache_hash (const char *str)
+{
+  char *hp = (char *) str - SC_HASH_SIZE;
+  unsigned int hash;
+
+  memcpy (&hash, hp, SC_HASH_SIZE);
+  if (hash == 0)
+    {
+      hash = (unsigned int) stable_hash (str);
+      memcpy (hp, &hash, SC_HASH_SIZE);
+    }
+
+  return hash;
+}
+
 void
 strcache_init (void)
 {
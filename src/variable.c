@@ -38,6 +38,33 @@ unsigned long long env_recursion = 0;
 /* Incremented every time we add or remove a global variable.  */
 static unsigned long variable_changenum = 0;
 
+/* Incremented every time a variable is defined or removed in any set, or a
+   set is linked into or out of a set list: whenever lookup_variable() might
+   find a different variable for a name.  */
+static unsigned long variable_set_changenum = 0;
+
+/* The variables found by lookup_variable() for the current set list.
+   A target's recipe refers to the same few variables over and over, and
+   each lookup hashes the name again in every set of a chain that goes
+   through its target, pattern and parent sets to the global set.  This
+   remembers the answers, so each name is found once.  Entries from before
+   the set list or VARIABLE_SET_CHANGENUM changed are stale.  */
+
+#define LOOKUP_CACHE_SIZE 256   /* Must be a power of 2.  */
+#define LOOKUP_CACHE_PROBES 4
+
+struct lookup_entry
+  {
+    unsigned long hash;         /* Hash of the name.  */
+    unsigned long epoch;        /* Valid if this is LOOKUP_EPOCH.  */
+    struct variable *var;       /* The variable found.  */
+  };
+
+static struct lookup_entry lookup_cache[LOOKUP_CACHE_SIZE];
+static const struct variable_set_list *lookup_setlist;
+static unsigned long lookup_changenum;
+static unsigned long lookup_epoch = 1;
+
 /* Chain of all pattern-specific variables.  */
 
 struct pattern_var *pattern_vars = NULL;
@@ -46,6 +73,78 @@ struct pattern_var *pattern_vars = NULL;
 
 static struct pattern_var *last_pattern_vars[256];
 
+/* The number of pattern-specific variables.  */
+
+static unsigned long pattern_var_count = 0;
+
+/* Pattern-specific variables grouped by the text around the '%' in their
+   patterns.  See build_pattern_index().  */
+
+#define PATTERN_KEY_MAX 16
+#define PATTERN_INDEX_MIN 16
+
+struct pattern_bucket
+  {
+    const char *prefix;         /* The first PLEN chars of the patterns.  */
+    const char *suffix;         /* The last SLEN chars of the patterns.  */
+    unsigned int plen;
+    unsigned int slen;
+    unsigned int count;         /* Number of VARS.  */
+    unsigned int size;          /* Number of VARS allocated.  */
+    struct pattern_var **vars;  /* In the order of PATTERN_VARS.  */
+  };
+
+static struct hash_table pattern_buckets;
+static unsigned int pattern_plens;      /* Bit N set if a PLEN is N.  */
+static unsigned int pattern_slens;      /* Bit N set if a SLEN is N.  */
+static int pattern_index_valid = 0;
+
+static unsigned long
+pattern_bucket_hash_1 (const void *keyv)
+{
+  const struct pattern_bucket *key = keyv;
+  unsigned long hash = key->plen * 17 + key->slen;
+
+  STRING_N_HASH_1 (key->prefix, key->plen, hash);
+  STRING_N_HASH_1 (key->suffix, key->slen, hash);
+  return hash;
+}
+
+static unsigned long
+pattern_bucket_hash_2 (const void *keyv)
+{
+  const struct pattern_bucket *key = keyv;
+  unsigned long hash = 0;
+
+  STRING_N_HASH_2 (key->prefix, key->plen, hash);
+  STRING_N_HASH_2 (key->suffix, key->slen, hash);
+  return hash;
+}
+
+static int
+pattern_bucket_hash_cmp (const void *xv, const void *yv)
+{
+  const struct pattern_bucket *x = xv;
+  const struct pattern_bucket *y = yv;
+  int result = (int) x->plen - (int) y->plen;
+
+  if (result == 0)
+    result = (int) x->slen - (int) y->slen;
+  if (result == 0)
+    result = memcmp (x->prefix, y->prefix, x->plen);
+  if (result == 0)
+    result = memcmp (x->suffix, y->suffix, x->slen);
+  return result;
+}
+
+static void
+free_pattern_bucket (const void *item)
+{
+  struct pattern_bucket *b = (struct pattern_bucket *) item;
+  free (b->vars);
+  free (b);
+}
+
 /* Create a new pattern-specific variable struct. The new variable is
    inserted into the PATTERN_VARS list in the shortest patterns first
    order to support the shortest stem matching (the variables are
@@ -98,46 +197,182 @@ create_pattern_var (const char *target, const char *suffix)
   if (len < 256)
     last_pattern_vars[len] = p;
 
+  ++pattern_var_count;
+  pattern_index_valid = 0;
+
   return p;
 }
 
-/* Look up a target in the pattern-specific variable list.  */
+/* Return nonzero if the pattern of P matches TARGET, of length TARGLEN.  */
+
+static int
+pattern_var_matches (const struct pattern_var *p, const char *target,
+                     size_t targlen)
+{
+  const char *stem;
+  size_t stemlen;
+
+  if (p->len > targlen)
+    /* It can't possibly match.  */
+    return 0;
+
+  /* From the lengths of the filename and the pattern parts,
+     find the stem: the part of the filename that matches the %.  */
+  stem = target + (p->suffix - p->target - 1);
+  stemlen = targlen - p->len + 1;
+
+  /* Compare the text in the pattern before the stem, if any.  */
+  if (stem > target && !strneq (p->target, target, stem - target))
+    return 0;
+
+  /* Compare the text in the pattern after the stem, if any.
+     We could test simply using streq, but this way we compare the
+     first two characters immediately.  This saves time in the very
+     common case where the first character matches because it is a
+     period.  */
+  return (*p->suffix == stem[stemlen]
+          && (*p->suffix == '\0' || streq (&p->suffix[1], &stem[stemlen+1])));
+}
+
+/* Index the pattern-specific variables by the text before and after the
+   '%' in their patterns, so a target needn't be compared with every one.
+   A bucket holds the patterns whose first PLEN chars and last SLEN chars
+   are the same, where PLEN and SLEN are the lengths of the text before and
+   after the '%', up to PATTERN_KEY_MAX.  A target can only match patterns
+   in the buckets keyed by its own first and last chars, so only those are
+   compared.  */
+
+static void
+build_pattern_index (void)
+{
+  struct pattern_var *p;
+  unsigned long n = 0;
+
+  if (pattern_buckets.ht_vec == NULL)
+    hash_init (&pattern_buckets, 1024, pattern_bucket_hash_1,
+               pattern_bucket_hash_2, pattern_bucket_hash_cmp);
+  else
+    {
+      hash_map (&pattern_buckets, free_pattern_bucket);
+      hash_delete_items (&pattern_buckets);
+    }
+  pattern_plens = pattern_slens = 0;
+
+  /* Walk the list in order, so each bucket is in order too.  */
+  for (p = pattern_vars; p != 0; p = p->next)
+    {
+      struct pattern_bucket key;
+      struct pattern_bucket **slot;
+      struct pattern_bucket *b;
+      size_t plen = p->suffix - p->target - 1;
+      size_t slen = p->len - plen - 1;
+
+      p->number = ++n;
+
+      key.plen = plen < PATTERN_KEY_MAX ? plen : PATTERN_KEY_MAX;
+      key.slen = slen < PATTERN_KEY_MAX ? slen : PATTERN_KEY_MAX;
+      key.prefix = p->target;
+      key.suffix = p->suffix + slen - key.slen;
+
+      slot = (struct pattern_bucket **) hash_find_slot (&pattern_buckets,
+                                                        &key);
+      b = *slot;
+      if (HASH_VACANT (b))
+        {
+          b = xmalloc (sizeof (struct pattern_bucket));
+          *b = key;
+          b->count = b->size = 0;
+          b->vars = NULL;
+          hash_insert_at (&pattern_buckets, b, slot);
+          pattern_plens |= 1U << b->plen;
+          pattern_slens |= 1U << b->slen;
+        }
+
+      if (b->count == b->size)
+        {
+          b->size = b->size ? b->size * 2 : 4;
+          b->vars = xrealloc (b->vars, b->size * sizeof (struct pattern_var *));
+        }
+      b->vars[b->count++] = p;
+    }
+
+  pattern_index_valid = 1;
+}
+
+/* Look up a target in the pattern-specific variable list.  Return the first
+   pattern-specific variable after START, or the first one if START is
+   NULL, whose pattern matches TARGET, or NULL if there is none.  */
 
 static struct pattern_var *
 lookup_pattern_var (struct pattern_var *start, const char *target,
                     size_t targlen)
 {
-  struct pattern_var *p;
+  struct pattern_var *best = NULL;
+  unsigned long after;
+  size_t pl, sl;
 
-  for (p = start ? start->next : pattern_vars; p != 0; p = p->next)
+  /* It's quicker to just look through a few.  */
+  if (pattern_var_count < PATTERN_INDEX_MIN)
     {
-      const char *stem;
-      size_t stemlen;
+      struct pattern_var *p;
 
-      if (p->len > targlen)
-        /* It can't possibly match.  */
-        continue;
+      for (p = start ? start->next : pattern_vars; p != 0; p = p->next)
+        if (pattern_var_matches (p, target, targlen))
+          break;
 
-      /* From the lengths of the filename and the pattern parts,
-         find the stem: the part of the filename that matches the %.  */
-      stem = target + (p->suffix - p->target - 1);
-      stemlen = targlen - p->len + 1;
+      return p;
+    }
 
-      /* Compare the text in the pattern before the stem, if any.  */
-      if (stem > target && !strneq (p->target, target, stem - target))
-        continue;
+  if (!pattern_index_valid)
+    build_pattern_index ();
 
-      /* Compare the text in the pattern after the stem, if any.
-         We could test simply using streq, but this way we compare the
-         first two characters immediately.  This saves time in the very
-         common case where the first character matches because it is a
-         period.  */
-      if (*p->suffix == stem[stemlen]
-          && (*p->suffix == '\0' || streq (&p->suffix[1], &stem[stemlen+1])))
-        break;
-    }
+  after = start ? start->number : 0;
 
-  return p;
+  for (pl = 0; pl <= PATTERN_KEY_MAX && pl <= targlen; ++pl)
+    if (pattern_plens & (1U << pl))
+      for (sl = 0; sl <= PATTERN_KEY_MAX && pl + sl <= targlen; ++sl)
+        if (pattern_slens & (1U << sl))
+          {
+            struct pattern_bucket key;
+            const struct pattern_bucket *b;
+            unsigned int lo, hi;
+
+            key.prefix = target;
+            key.plen = (unsigned int) pl;
+            key.suffix = target + targlen - sl;
+            key.slen = (unsigned int) sl;
+
+            b = hash_find_item (&pattern_buckets, &key);
+            if (b == NULL)
+              continue;
+
+            /* Find the first variable in this bucket after START.  */
+            lo = 0;
+            hi = b->count;
+            while (lo < hi)
+              {
+                unsigned int mid = lo + (hi - lo) / 2;
+                if (b->vars[mid]->number <= after)
+                  lo = mid + 1;
+                else
+                  hi = mid;
+              }
+
+            for (; lo < b->count; ++lo)
+              {
+                struct pattern_var *p = b->vars[lo];
+
+                if (best && p->number > best->number)
+                  break;
+                if (pattern_var_matches (p, target, targlen))
+                  {
+                    best = p;
+                    break;
+                  }
+              }
+          }
+
+  return best;
 }
 
 /* Hash table of all global variable definitions.  */
@@ -267,6 +502,8 @@ define_variable_in_set (const char *name, size_t length,
   if (env_overrides && origin == o_env)
     origin = o_env_override;
 
+  ++variable_set_changenum;
+
   if (! HASH_VACANT (v))
     {
       if (env_overrides && v->origin == o_env)
@@ -279,6 +516,7 @@ define_variable_in_set (const char *name, size_t length,
          than this one, don't redefine it.  */
       if ((int) origin >= (int) v->origin)
         {
+          forget_expansion (v);
           free (v->value);
           v->value = xstrdup (value);
           if (flocp != 0)
@@ -336,6 +574,7 @@ static void
 free_variable_name_and_value (const void *item)
 {
   struct variable *v = (struct variable *) item;
+  forget_expansion (v);
   free (v->name);
   free (v->value);
 }
@@ -343,12 +582,58 @@ free_variable_name_and_value (const void *item)
 void
 free_variable_set (struct variable_set_list *list)
 {
-  hash_map (&list->set->table, free_variable_name_and_value);
-  hash_free (&list->set->table, 1);
-  free (list->set);
+  ++variable_set_changenum;
+  if (list->set->refs > 1)
+    --list->set->refs;
+  else
+    {
+      hash_map (&list->set->table, free_variable_name_and_value);
+      hash_free (&list->set->table, 1);
+      free (list->set);
+    }
   free (list);
 }
 
+/* Give LIST a copy of its variable set, if the set is shared, so that it
+   can be changed.  */
+
+static void
+unshare_variable_set (struct variable_set_list *list)
+{
+  struct variable_set *from = list->set;
+  struct variable_set *to;
+  struct variable **v_slot;
+  struct variable **v_end;
+
+  if (from->refs <= 1)
+    return;
+
+  to = xmalloc (sizeof (struct variable_set));
+  hash_init (&to->table, from->table.ht_fill,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+  to->refs = 1;
+
+  v_slot = (struct variable **) from->table.ht_vec;
+  v_end = v_slot + from->table.ht_size;
+  for ( ; v_slot < v_end; v_slot++)
+    if (! HASH_VACANT (*v_slot))
+      {
+        struct variable *v = xmalloc (sizeof (struct variable));
+        *v = **v_slot;
+        v->name = xstrdup (v->name);
+        v->value = xstrdup (v->value);
+        v->compiled = NULL;
+        v->value_size = 0;
+        v->words = NULL;
+        v->env = NULL;
+        hash_insert (&to->table, v);
+      }
+
+  --from->refs;
+  list->set = to;
+  ++variable_set_changenum;
+}
+
 void
 undefine_variable_in_set (const floc *flocp, const char *name, size_t length,
                           enum variable_origin origin,
@@ -385,6 +670,7 @@ undefine_variable_in_set (const floc *flocp, const char *name, size_t length,
           hash_delete_at (&set->table, var_slot);
           free_variable_name_and_value (v);
           free (v);
+          ++variable_set_changenum;
           if (set == &global_variable_set)
             ++variable_changenum;
         }
@@ -503,10 +789,51 @@ lookup_variable (const char *name, size_t length)
 {
   const struct variable_set_list *setlist;
   struct variable var_key;
+  struct lookup_entry *entry = NULL;
   int is_parent = 0;
 
   check_variable_reference (name, length);
 
+  /* There's no point in remembering lookups in a single set.  */
+  if (current_variable_set_list && current_variable_set_list->next != NULL)
+    {
+      unsigned long hash = 0;
+      unsigned int i, n;
+
+      if (lookup_setlist != current_variable_set_list
+          || lookup_changenum != variable_set_changenum)
+        {
+          /* Everything we remember is stale.  */
+          lookup_setlist = current_variable_set_list;
+          lookup_changenum = variable_set_changenum;
+          ++lookup_epoch;
+        }
+
+      STRING_N_HASH_1 (name, length, hash);
+
+      for (i = 0; i < LOOKUP_CACHE_PROBES; ++i)
+        {
+          struct lookup_entry *e;
+
+          n = (unsigned int) (hash + i) & (LOOKUP_CACHE_SIZE - 1);
+          e = &lookup_cache[n];
+          if (e->epoch != lookup_epoch)
+            {
+              if (!entry)
+                entry = e;
+              continue;
+            }
+          if (e->hash == hash && e->var->length == length
+              && memcmp (e->var->name, name, length) == 0)
+            return e->var->special ? lookup_special_var (e->var) : e->var;
+        }
+
+      /* Replace the first stale entry, or else the name's own slot.  */
+      if (!entry)
+        entry = &lookup_cache[hash & (LOOKUP_CACHE_SIZE - 1)];
+      entry->hash = hash;
+    }
+
   var_key.name = (char *) name;
   var_key.length = (unsigned int) length;
 
@@ -518,7 +845,14 @@ lookup_variable (const char *name, size_t length)
 
       v = hash_find_item ((struct hash_table *) &set->table, &var_key);
       if (v && (!is_parent || !v->private_var))
-        return v->special ? lookup_special_var (v) : v;
+        {
+          if (entry)
+            {
+              entry->epoch = lookup_epoch;
+              entry->var = v;
+            }
+          return v->special ? lookup_special_var (v) : v;
+        }
 
       is_parent |= setlist->next_is_parent;
     }
@@ -622,6 +956,80 @@ lookup_variable_in_set (const char *name, size_t length,
   return hash_find_item ((struct hash_table *) &set->table, &var_key);
 }
 
+/* Sets of pattern-specific variables can be shared by all the files that
+   match the same pattern variables: they're never changed once they're
+   set up, unless they're merged into another file's, which copies them
+   first.  A set is keyed by the list of pattern variables that were put in
+   it, in order.  */
+
+struct shared_pattern_set
+  {
+    struct pattern_var **vars;  /* The pattern variables in the set.  */
+    unsigned long count;        /* How many there are.  */
+    struct variable_set *set;   /* The set, with one reference of our own.  */
+  };
+
+static struct hash_table shared_pattern_sets;
+
+static unsigned long
+shared_pattern_set_hash_1 (const void *keyv)
+{
+  const struct shared_pattern_set *key = keyv;
+  return jhash ((const unsigned char *) key->vars,
+                (int) (key->count * sizeof (struct pattern_var *)));
+}
+
+static unsigned long
+shared_pattern_set_hash_2 (const void *keyv)
+{
+  /* Not the pattern variables' numbers: build_pattern_index() changes them
+     when more pattern variables are defined.  */
+  return shared_pattern_set_hash_1 (keyv) >> 16;
+}
+
+static int
+shared_pattern_set_hash_cmp (const void *xv, const void *yv)
+{
+  const struct shared_pattern_set *x = xv;
+  const struct shared_pattern_set *y = yv;
+
+  if (x->count != y->count)
+    return x->count < y->count ? -1 : 1;
+  return memcmp (x->vars, y->vars, x->count * sizeof (struct pattern_var *));
+}
+
+/* Return nonzero if defining P in the pattern variable set SET gives the
+   same result whenever it's done: the definition doesn't expand anything,
+   run anything, depend on other variables or have side-effects.  */
+
+static int
+pattern_var_shareable (const struct pattern_var *p,
+                       struct variable_set *set)
+{
+  const struct variable *v = &p->variable;
+  const struct variable *old;
+
+  if (v->conditional || streq (v->name, "SHELL")
+      || streq (v->name, MAKEFLAGS_NAME))
+    return 0;
+
+  switch (v->flavor)
+    {
+    case f_simple:
+    case f_recursive:
+    case f_append_value:
+      return 1;
+
+    case f_append:
+      /* Appending to a simple variable expands the new value.  */
+      old = lookup_variable_in_set (v->name, strlen (v->name), set);
+      return old == NULL || old->recursive;
+
+    default:
+      return 0;
+    }
+}
+
 /* Initialize FILE's variable set list.  If FILE already has a variable set
    list, the topmost variable set is left intact, but the the rest of the
    chain is replaced with FILE->parent's setlist.  If FILE is a double-colon
@@ -643,6 +1051,7 @@ initialize_file_variables (struct file *file, int reading)
       l->set = xmalloc (sizeof (struct variable_set));
       hash_init (&l->set->table, PERFILE_VARIABLE_BUCKETS,
                  variable_hash_1, variable_hash_2, variable_hash_cmp);
+      l->set->refs = 1;
       file->variables = l;
     }
 
@@ -674,11 +1083,47 @@ initialize_file_variables (struct file *file, int reading)
     {
       struct pattern_var *p;
       const size_t targlen = strlen (file->name);
+      struct shared_pattern_set key;
+      struct shared_pattern_set *ps;
+      unsigned long size = 0;
+
+      /* Find all the pattern variables that match this target.  */
+      key.vars = NULL;
+      key.count = 0;
+      for (p = lookup_pattern_var (0, file->name, targlen); p != 0;
+           p = lookup_pattern_var (p, file->name, targlen))
+        {
+          if (key.count == size)
+            {
+              size = size ? size * 2 : 16;
+              key.vars = xrealloc (key.vars,
+                                   size * sizeof (struct pattern_var *));
+            }
+          key.vars[key.count++] = p;
+        }
 
-      p = lookup_pattern_var (0, file->name, targlen);
-      if (p != 0)
+      ps = NULL;
+      if (key.count != 0)
+        {
+          if (shared_pattern_sets.ht_vec == 0)
+            hash_init (&shared_pattern_sets, 256, shared_pattern_set_hash_1,
+                       shared_pattern_set_hash_2, shared_pattern_set_hash_cmp);
+          ps = hash_find_item (&shared_pattern_sets, &key);
+        }
+
+      if (ps != 0)
+        {
+          /* Another file matched the same pattern variables: use its set.  */
+          file->pat_variables = xmalloc (sizeof (struct variable_set_list));
+          file->pat_variables->set = ps->set;
+          ++ps->set->refs;
+          free (key.vars);
+        }
+      else if (key.count != 0)
         {
           struct variable_set_list *global = current_variable_set_list;
+          int shareable = 1;
+          unsigned long i;
 
           /* We found at least one.  Set up a new variable set to accumulate
              all the pattern variables that match this target.  */
@@ -686,12 +1131,16 @@ initialize_file_variables (struct file *file, int reading)
           file->pat_variables = create_new_variable_set ();
           current_variable_set_list = file->pat_variables;
 
-          do
+          for (i = 0; i < key.count; ++i)
             {
-              /* We found one, so insert it into the set.  */
+              /* Insert the next one into the set.  */
 
               struct variable *v;
 
+              p = key.vars[i];
+              shareable = shareable && pattern_var_shareable (
+                p, file->pat_variables->set);
+
               if (p->variable.flavor == f_simple)
                 {
                   v = define_variable_loc (
@@ -711,10 +1160,21 @@ initialize_file_variables (struct file *file, int reading)
               v->per_target = p->variable.per_target;
               v->export = p->variable.export;
               v->private_var = p->variable.private_var;
+              shareable = shareable && !v->special;
             }
-          while ((p = lookup_pattern_var (p, file->name, targlen)) != 0);
 
           current_variable_set_list = global;
+
+          if (shareable)
+            {
+              ps = xmalloc (sizeof (struct shared_pattern_set));
+              *ps = key;
+              ps->set = file->pat_variables->set;
+              ++ps->set->refs;
+              hash_insert (&shared_pattern_sets, ps);
+            }
+          else
+            free (key.vars);
         }
       file->pat_searched = 1;
     }
@@ -728,6 +1188,8 @@ initialize_file_variables (struct file *file, int reading)
       l->next = file->pat_variables;
       l->next_is_parent = 0;
     }
+
+  ++variable_set_changenum;
 }
 
 /* Pop the top set off the current variable set list,
@@ -742,6 +1204,7 @@ create_new_variable_set (void)
   set = xmalloc (sizeof (struct variable_set));
   hash_init (&set->table, SMALL_SCOPE_VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
+  set->refs = 1;
 
   setlist = (struct variable_set_list *)
     xmalloc (sizeof (struct variable_set_list));
@@ -749,6 +1212,8 @@ create_new_variable_set (void)
   setlist->next = current_variable_set_list;
   setlist->next_is_parent = 0;
 
+  ++variable_set_changenum;
+
   return setlist;
 }
 
@@ -805,6 +1270,8 @@ pop_variable_scope (void)
       global_setlist.next_is_parent = setlist->next_is_parent;
     }
 
+  ++variable_set_changenum;
+
   /* Free the one we no longer need.  */
   free (setlist);
   hash_map (&set->table, free_variable_name_and_value);
@@ -866,10 +1333,12 @@ merge_variable_sets (struct variable_set *to_set,
           {
             hash_insert_at (&to_set->table, from_var, to_var_slot);
             variable_changenum += inc;
+            ++variable_set_changenum;
           }
         else
           {
             /* GKM FIXME: delete in from_set->table */
+            forget_expansion (from_var);
             free (from_var->value);
             free (from_var);
           }
@@ -908,6 +1377,8 @@ merge_variable_set_lists (struct variable_set_list **setlist0,
           struct variable_set_list *from = setlist1;
           setlist1 = setlist1->next;
 
+          unshare_variable_set (to);
+          unshare_variable_set (from);
           merge_variable_sets (to->set, from->set);
 
           last0 = to;
@@ -922,6 +1393,8 @@ merge_variable_set_lists (struct variable_set_list **setlist0,
       else
         last0->next = setlist1;
     }
+
+  ++variable_set_changenum;
 }
 
 /* Define the automatic variables, and record the addresses
@@ -985,6 +1458,7 @@ define_automatic_variables (void)
           || shell->origin == o_env_override))
         {
           /* overwrite whatever we got from the environment */
+          forget_expansion (shell);
           free (shell->value);
           shell->value = xstrdup (default_shell);
           shell->origin = o_default;
@@ -1032,6 +1506,7 @@ define_automatic_variables (void)
   /* Don't let SHELL come from the environment.  */
   if (*v->value == '\0' || v->origin == o_env || v->origin == o_env_override)
     {
+      forget_expansion (v);
       free (v->value);
       v->origin = o_file;
       v->value = xstrdup (default_shell);
@@ -1080,10 +1555,12 @@ define_automatic_variables (void)
 }
 
 
+/* Return nonzero if V should be exported, if its export status is EXPORT.  */
+
 static int
-should_export (const struct variable *v)
+should_export (const struct variable *v, enum variable_export export)
 {
-  switch (v->export)
+  switch (export)
     {
     case v_export:
       break;
@@ -1115,10 +1592,81 @@ should_export (const struct variable *v)
   return 1;
 }
 
+/* An entry in a child's environment, "NAME=VALUE".  A variable whose value
+   goes into the environment unchanged keeps its entry in V->env, so that
+   every environment it appears in shares the same string instead of
+   formatting and allocating a new one for every job.  */
+
+struct env_string
+  {
+    unsigned long refs;         /* Environments and variables using it.  */
+    char str[1];                /* "NAME=VALUE".  */
+  };
+
+#define ENV_STRING(_s) \
+  ((struct env_string *) ((_s) - offsetof (struct env_string, str)))
+
+static struct env_string *
+new_env_string (const char *name, size_t length, const char *value)
+{
+  size_t vlen = strlen (value);
+  struct env_string *es = xmalloc (sizeof (struct env_string)
+                                   + length + 1 + vlen);
+  char *cp = es->str;
+
+  es->refs = 1;
+  cp = mempcpy (cp, name, length);
+  *cp++ = '=';
+  memcpy (cp, value, vlen + 1);
+
+  return es;
+}
+
+void
+release_env_string (struct env_string *es)
+{
+  if (es && --es->refs == 0)
+    free (es);
+}
+
+/* Free an environment returned by target_environment().  */
+
+void
+free_target_environment (char **envp)
+{
+  char **ep;
+
+  for (ep = envp; *ep != NULL; ++ep)
+    release_env_string (ENV_STRING (*ep));
+  free (envp);
+}
+
+/* Return the export status of V, the first variable with its name in
+   SET_LIST.  If V doesn't say, it's that of the next variable with its
+   name that V inherits from.  V itself is not changed, as its set might
+   be shared with other set lists.  */
+
+static enum variable_export
+inherited_export (struct variable *v, struct variable_set_list *set_list)
+{
+  enum variable_export export = v->export;
+  struct variable_set_list *s;
+
+  for (s = set_list; export == v_default && s != 0; s = s->next)
+    {
+      struct variable *w = hash_find_item (&s->set->table, v);
+      if (w && w != v && (s == set_list || !w->private_var))
+        export = w->export;
+    }
+
+  return export;
+}
+
 /* Create a new environment for FILE's commands.
    If FILE is nil, this is for the 'shell' function.
    The child's MAKELEVEL variable is incremented.
-   If recursive is true then we're running a recursive make, else not.  */
+   If recursive is true then we're running a recursive make, else not.
+   The result must be freed with free_target_environment().  */
 
 char **
 target_environment (struct file *file, int recursive)
@@ -1126,6 +1674,10 @@ target_environment (struct file *file, int recursive)
   struct variable_set_list *set_list;
   struct variable_set_list *s;
   struct hash_table table;
+  struct variable **exports;
+  struct variable **vp;
+  enum variable_export *how;
+  size_t nlocal;
   struct variable **v_slot;
   struct variable **v_end;
   char **result_0;
@@ -1136,6 +1688,8 @@ target_environment (struct file *file, int recursive)
   int found_makelevel = 0;
   int found_mflags = 0;
   int found_makeflags = 0;
+  int global_islocal = 0;
+  unsigned long long lengths = 0;
 
   /* If file is NULL we're creating the target environment for $(shell ...)
      Remember this so we can just ignore recursion.  */
@@ -1152,17 +1706,22 @@ target_environment (struct file *file, int recursive)
   else
     set_list = current_variable_set_list;
 
-  hash_init (&table, VARIABLE_BUCKETS,
+  hash_init (&table, PERFILE_VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
 
-  /* Run through all the variable sets in the list, accumulating variables
-     in TABLE.  We go from most specific to least, so the first variable we
-     encounter is the keeper.  */
+  /* Run through all the variable sets in the list except the global one,
+     accumulating variables in TABLE.  We go from most specific to least, so
+     the first variable we encounter is the keeper.  */
   for (s = set_list; s != 0; s = s->next)
     {
       struct variable_set *set = s->set;
       const int islocal = s == set_list;
-      const int isglobal = set == &global_variable_set;
+
+      if (set == &global_variable_set)
+        {
+          global_islocal = islocal;
+          continue;
+        }
 
       v_slot = (struct variable **) set->table.ht_vec;
       v_end = v_slot + set->table.ht_size;
@@ -1181,137 +1740,184 @@ target_environment (struct file *file, int recursive)
               {
                 /* We'll always add target-specific variables, since we may
                    discover that they should be exported later: we'll check
-                   again below.  For global variables only add them if they're
-                   exportable.  */
-                if (!isglobal || should_export (v))
-                  hash_insert_at (&table, v, evslot);
+                   again below.  */
+                hash_insert_at (&table, v, evslot);
+                lengths |= 1ULL << (v->length % 64);
               }
-            else if ((*evslot)->export == v_default)
-              /* We already have a variable but we don't know its status.  */
-              (*evslot)->export = v->export;
           }
     }
 
-  result = result_0 = xmalloc ((table.ht_fill + 3) * sizeof (char *));
+  exports = vp = xmalloc ((table.ht_fill + global_variable_set.table.ht_fill)
+                          * sizeof (struct variable *));
+  how = xmalloc (table.ht_fill * sizeof (enum variable_export));
 
   v_slot = (struct variable **) table.ht_vec;
   v_end = v_slot + table.ht_size;
+  for ( ; v_slot < v_end; v_slot++)
+    if (! HASH_VACANT (*v_slot))
+      {
+        how[vp - exports] = inherited_export (*v_slot, set_list);
+        *vp++ = *v_slot;
+      }
+  nlocal = vp - exports;
+
+  /* The global variables come last.  TABLE is usually tiny, so rather than
+     copying the global set into it we add each exportable global variable
+     unless TABLE has one by that name.  LENGTHS tells us when that can't be,
+     without hashing the name.  */
+  v_slot = (struct variable **) global_variable_set.table.ht_vec;
+  v_end = v_slot + global_variable_set.table.ht_size;
   for ( ; v_slot < v_end; v_slot++)
     if (! HASH_VACANT (*v_slot))
       {
         struct variable *v = *v_slot;
-        char *value = v->value;
-        char *cp = NULL;
 
-        /* This might be here because it was a target-specific variable that
-           we didn't know the status of when we added it.  */
-        if (! should_export (v))
+        if ((!global_islocal && v->private_var)
+            || ! should_export (v, v->export))
           continue;
 
-        /* If V is recursively expanded and didn't come from the environment,
-           expand its value.  If it came from the environment, it should
-           go back into the environment unchanged... except MAKEFLAGS.  */
-        if (v->recursive && ((v->origin != o_env && v->origin != o_env_override)
-                             || streq (v->name, MAKEFLAGS_NAME)))
-          value = cp = recursively_expand_for_file (v, file);
+        if ((lengths & (1ULL << (v->length % 64)))
+            && hash_find_item (&table, v))
+          continue;
 
-        /* If this is the SHELL variable remember we already added it.  */
-        if (!added_SHELL && streq (v->name, "SHELL"))
-          {
-            added_SHELL = 1;
-            goto setit;
-          }
+        *vp++ = v;
+      }
 
-        /* If this is MAKELEVEL, update it.  */
-        if (!found_makelevel && streq (v->name, MAKELEVEL_NAME))
-          {
-            char val[INTSTR_LENGTH + 1];
-            sprintf (val, "%u", makelevel + 1);
-            free (cp);
-            value = cp = xstrdup (val);
-            found_makelevel = 1;
-            goto setit;
-          }
+  hash_free (&table, 0);
 
-        /* If we need to reset jobserver, check for MAKEFLAGS / MFLAGS.  */
-        if (invalid)
-          {
-            if (!found_makeflags && streq (v->name, MAKEFLAGS_NAME))
-              {
-                char *mf;
-                char *vars;
-                found_makeflags = 1;
+  result = result_0 = xmalloc ((vp - exports + 3) * sizeof (char *));
 
-                if (!strstr (value, " --" JOBSERVER_AUTH_OPT "="))
-                  goto setit;
+  for (v_end = vp, vp = exports; vp < v_end; ++vp)
+    {
+      struct variable *v = *vp;
+      char *value = v->value;
+      char *cp = NULL;
+
+      /* This might be here because it was a target-specific variable that
+         we didn't know the status of when we added it.  */
+      if (! should_export (v, ((size_t) (vp - exports) < nlocal
+                               ? how[vp - exports] : v->export)))
+        continue;
 
-                /* The invalid option must come before variable overrides.  */
-                vars = strstr (value, " -- ");
-                if (!vars)
-                  mf = xstrdup (concat (2, value, invalid));
-                else
-                  {
-                    size_t lf = vars - value;
-                    size_t li = strlen (invalid);
-                    mf = xmalloc (strlen (value) + li + 1);
-                    strcpy (mempcpy (mempcpy (mf, value, lf), invalid, li),
-                            vars);
-                  }
-                free (cp);
-                value = cp = mf;
-                if (found_mflags)
-                  invalid = NULL;
+      /* If V is recursively expanded and didn't come from the environment,
+         expand its value.  If it came from the environment, it should
+         go back into the environment unchanged... except MAKEFLAGS.  */
+      if (v->recursive && ((v->origin != o_env && v->origin != o_env_override)
+                           || streq (v->name, MAKEFLAGS_NAME)))
+        value = cp = recursively_expand_for_file (v, file);
+
+      /* If this is the SHELL variable remember we already added it.  */
+      if (!added_SHELL && streq (v->name, "SHELL"))
+        {
+          added_SHELL = 1;
+          goto setit;
+        }
+
+      /* If this is MAKELEVEL, update it.  */
+      if (!found_makelevel && streq (v->name, MAKELEVEL_NAME))
+        {
+          char val[INTSTR_LENGTH + 1];
+          sprintf (val, "%u", makelevel + 1);
+          free (cp);
+          value = cp = xstrdup (val);
+          found_makelevel = 1;
+          goto setit;
+        }
+
+      /* If we need to reset jobserver, check for MAKEFLAGS / MFLAGS.  */
+      if (invalid)
+        {
+          if (!found_makeflags && streq (v->name, MAKEFLAGS_NAME))
+            {
+              char *mf;
+              char *vars;
+              found_makeflags = 1;
+
+              if (!strstr (value, " --" JOBSERVER_AUTH_OPT "="))
                 goto setit;
-              }
 
-            if (!found_mflags && streq (v->name, "MFLAGS"))
-              {
-                const char *mf;
-                found_mflags = 1;
-
-                if (!strstr (value, " --" JOBSERVER_AUTH_OPT "="))
-                  goto setit;
-
-                if (v->origin != o_env)
-                  goto setit;
-                mf = concat (2, value, invalid);
-                free (cp);
-                value = cp = xstrdup (mf);
-                if (found_makeflags)
-                  invalid = NULL;
+              /* The invalid option must come before variable overrides.  */
+              vars = strstr (value, " -- ");
+              if (!vars)
+                mf = xstrdup (concat (2, value, invalid));
+              else
+                {
+                  size_t lf = vars - value;
+                  size_t li = strlen (invalid);
+                  mf = xmalloc (strlen (value) + li + 1);
+                  strcpy (mempcpy (mempcpy (mf, value, lf), invalid, li),
+                          vars);
+                }
+              free (cp);
+              value = cp = mf;
+              if (found_mflags)
+                invalid = NULL;
+              goto setit;
+            }
+
+          if (!found_mflags && streq (v->name, "MFLAGS"))
+            {
+              const char *mf;
+              found_mflags = 1;
+
+              if (!strstr (value, " --" JOBSERVER_AUTH_OPT "="))
                 goto setit;
-              }
-          }
+
+              if (v->origin != o_env)
+                goto setit;
+              mf = concat (2, value, invalid);
+              free (cp);
+              value = cp = xstrdup (mf);
+              if (found_makeflags)
+                invalid = NULL;
+              goto setit;
+            }
+        }
 
 #if MK_OS_W32
-        if (streq (v->name, "Path") || streq (v->name, "PATH"))
-          {
-            if (!cp)
-              cp = xstrdup (value);
-            value = convert_Path_to_windows32 (cp, ';');
-            goto setit;
-          }
+      if (streq (v->name, "Path") || streq (v->name, "PATH"))
+        {
+          if (!cp)
+            cp = xstrdup (value);
+          value = convert_Path_to_windows32 (cp, ';');
+          goto setit;
+        }
 #endif
 
-      setit:
-        *result++ = xstrdup (concat (3, v->name, "=", value));
-        free (cp);
-      }
+    setit:
+      if (cp)
+        *result++ = new_env_string (v->name, v->length, value)->str;
+      else
+        {
+          /* The value is unchanged: share the string we made for it
+             last time, if the value hasn't changed since then.  */
+          if (!v->env || !streq (v->env->str + v->length + 1, value))
+            {
+              release_env_string (v->env);
+              v->env = new_env_string (v->name, v->length, value);
+            }
+          ++v->env->refs;
+          *result++ = v->env->str;
+        }
+      free (cp);
+    }
+
+  free (exports);
+  free (how);
 
   if (!added_SHELL)
-    *result++ = xstrdup (concat (3, shell_var.name, "=", shell_var.value));
+    *result++ = new_env_string (shell_var.name, shell_var.length,
+                                shell_var.value)->str;
 
   if (!found_makelevel)
     {
-      char val[MAKELEVEL_LENGTH + 1 + INTSTR_LENGTH + 1];
-      sprintf (val, "%s=%u", MAKELEVEL_NAME, makelevel + 1);
-      *result++ = xstrdup (val);
+      char val[INTSTR_LENGTH + 1];
+      sprintf (val, "%u", makelevel + 1);
+      *result++ = new_env_string (MAKELEVEL_NAME, MAKELEVEL_LENGTH, val)->str;
     }
 
   *result = NULL;
 
-  hash_free (&table, 0);
-
   if (!file)
     --env_recursion;
 
@@ -1362,6 +1968,36 @@ shell_result (const char *p)
   return swap_variable_buffer (buf, len);
 }
 
+/* Append the VALLEN chars at VAL to the value of V, after a space.
+   The value's length and allocated size are remembered, and the buffer
+   grows geometrically, so building a long list with += takes linear time
+   rather than copying the whole list for every word.  */
+
+static void
+append_variable_value (struct variable *v, const char *val, size_t vallen)
+{
+  size_t len = v->value_size ? v->value_length : strlen (v->value);
+  size_t size = v->value_size;
+  size_t need = len + 1 + vallen + 1;
+  char *cp;
+
+  forget_expansion (v);
+
+  if (need > size)
+    {
+      size = size * 2 > need ? size * 2 : need * 2;
+      v->value = xrealloc (v->value, size);
+    }
+
+  cp = v->value + len;
+  if (len)
+    *(cp++) = ' ';
+  memcpy (cp, val, vallen + 1);
+
+  v->value_length = cp - v->value + vallen;
+  v->value_size = size;
+}
+
 /* Given a variable, a value, and a flavor, define the variable.
    See the try_variable_definition() function for details on the parameters. */
 
@@ -1512,6 +2148,31 @@ do_variable_definition (const floc *flocp, const char *varname, const char *valu
                 goto done;
               }
 
+            /* If V is the variable that would be redefined, append to its
+               value where it is.  Special variables, and those that have
+               other side-effects when set, go the long way.  */
+            if (!v->special && !streq (varname, MAKEFLAGS_NAME)
+                && !streq (varname, "SHELL")
+                && (int) origin >= (int) v->origin
+                && !(env_overrides && (origin == o_env || v->origin == o_env))
+                && lookup_variable_in_set (varname, strlen (varname),
+                                           (scope == s_global
+                                            ? &global_variable_set
+                                            : current_variable_set_list->set))
+                   == v)
+              {
+                append_variable_value (v, val, vallen);
+                free (tp);
+                if (flocp != 0)
+                  v->fileinfo = *flocp;
+                else
+                  v->fileinfo.filenm = 0;
+                v->origin = origin;
+                v->append = append;
+                v->conditional = conditional;
+                goto done;
+              }
+
             oldlen = strlen (v->value);
             alloclen = oldlen + 1 + vallen + 1;
             cp = alloc_value = xmalloc (alloclen);
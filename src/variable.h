@@ -65,10 +65,19 @@ enum variable_scope
 #define EXP_COUNT_BITS  15      /* This gets all the bitfields into 32 bits */
 #define EXP_COUNT_MAX   ((1<<EXP_COUNT_BITS)-1)
 
+struct expansion;
+struct word_index;
+struct env_string;
+
 struct variable
   {
     char *name;                 /* Variable name.  */
     char *value;                /* Variable value.  */
+    struct expansion *compiled; /* Parsed form of a recursive value.  */
+    size_t value_length;        /* strlen (value), if value_size is set.  */
+    size_t value_size;          /* Bytes allocated for value by +=, or 0.  */
+    struct word_index *words;   /* Where the words of a simple value are.  */
+    struct env_string *env;     /* "NAME=VALUE" last given to a child.  */
     floc fileinfo;              /* Where the variable was defined.  */
     unsigned int length;        /* strlen (name) */
     unsigned int recursive:1;   /* Gets recursively re-evaluated.  */
@@ -82,6 +91,7 @@ struct variable
     unsigned int expanding:1;   /* Nonzero if currently being expanded.  */
     unsigned int private_var:1; /* Nonzero avoids inheritance of this
                                    target-specific variable.  */
+    unsigned int expanded:1;    /* Nonzero if expanded since it was set.  */
     unsigned int exp_count:EXP_COUNT_BITS;
                                 /* If >1, allow this many self-referential
                                    expansions.  */
@@ -98,6 +108,8 @@ struct variable
 struct variable_set
   {
     struct hash_table table;    /* Hash table of variables.  */
+    unsigned int refs;          /* Number of users; if >1 copy it to change
+                                   it.  */
   };
 
 /* Structure that represents a list of variable sets.  */
@@ -117,6 +129,7 @@ struct pattern_var
     const char *suffix;
     const char *target;
     size_t len;
+    unsigned long number;       /* Position in the list, from 1.  */
     struct variable variable;
   };
 
@@ -147,9 +160,27 @@ char *expand_variable_buf (char *buf, const char *name, size_t length);
 #define expand_variable(n,l) expand_variable_buf (NULL, (n), (l));
 char *allocated_expand_variable (const char *name, size_t length);
 char *allocated_expand_variable_for_file (const char *name, size_t length, struct file *file);
+void forget_expansion (struct variable *v);
+struct variable *simple_variable_reference (const char *string,
+                                            size_t length);
 
 /* function.c */
+struct function_table_entry;
+extern unsigned long function_changenum;
+extern unsigned long pure_changenum;
 int handle_function (char **op, const char **stringp);
+const struct function_table_entry *find_function_call (const char *s,
+                                                       const char **argsp,
+                                                       const char **endp,
+                                                       unsigned int *nargsp);
+const char *function_argument_end (const struct function_table_entry *entry_p,
+                                   unsigned int argn, char openparen,
+                                   const char *p, const char *end);
+int function_expands_args (const struct function_table_entry *entry_p);
+int function_takes_word_list (const struct function_table_entry *entry_p);
+char *expand_builtin_function (char *o, unsigned int argc, char **argv,
+                               const struct function_table_entry *entry_p,
+                               struct variable *list);
 int pattern_matches (const char *pattern, const char *percent, const char *str);
 char *subst_expand (char *o, const char *text, const char *subst,
                     const char *replace, size_t slen, size_t rlen,
@@ -159,6 +190,7 @@ char *patsubst_expand_pat (char *o, const char *text, const char *pattern,
                            const char *replace_percent);
 char *patsubst_expand (char *o, const char *text, char *pattern, char *replace);
 char *func_shell_base (char *o, char **argv, int trim_newlines);
+void memo_print_stats (const char *prefix);
 void shell_completed (int exit_code, int exit_sig);
 
 /* variable.c */
@@ -246,6 +278,8 @@ void undefine_variable_in_set (const floc *flocp,
           undefine_variable_in_set((f),(n),(l),(o),NULL)
 
 char **target_environment (struct file *file, int recursive);
+void free_target_environment (char **envp);
+void release_env_string (struct env_string *es);
 
 struct pattern_var *create_pattern_var (const char *target,
                                         const char *suffix);